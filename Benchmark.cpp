@@ -0,0 +1,369 @@
+#include "Game.h"
+#include "Materials.h"
+#include "Scenarios.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+// Benchmark suite: runs a fixed set of seeded scenes and reports their throughput and tick latency
+// Usage: Benchmark [--ticks N] [--warmup N] [--repeat N] [--seed N] [--threads N] [--only name]
+//        [--json path] [--baseline path] [--tolerance percent] [--materials path] [--velocity] [--margolus]
+// Exits with 2 when --baseline is given and a scene got slower than the tolerance allows. A baseline recorded
+// with other settings (grid, ticks, warmup, seed, threads, movement or materials) is refused.
+
+// The scenes players actually build, the suite always runs them in this order
+const char* const BENCHMARK_SCENES[] = {
+    "lava_lake", "methane_fire", "burning_forest", "sand_avalanche", "clone_flood", "density_stack",
+};
+
+// Bumped when the JSON layout changes, baselines of another version are refused
+const int BENCHMARK_FORMAT_VERSION = 3;
+
+const int EXIT_REGRESSION = 2;
+
+struct BenchmarkOptions {
+    int ticks = 600;
+    int warmup = 60;
+    int repeat = 3; // Runs per scene, the fastest one is reported
+    unsigned int seed = 0;
+    int threads = 1;
+    std::string only; // Run just this scene
+    std::string json; // Results as JSON
+    std::string baseline; // JSON of an earlier run to compare against
+    double tolerance = 10.0; // Percent a scene may lose before it counts as a regression
+    std::string materials = DEFAULT_MATERIALS_PATH;
+    uint64_t materialsHash = 0; // HashMaterialSet of the loaded materials, set once they are loaded
+    bool velocity = false; // Move falling particles by velocity (see IntegrateVelocity)
+    bool margolus = false; // Move particles with the Margolus block engine (see Margolus.h)
+};
+
+struct SceneResult {
+    std::string name;
+    double ticksPerSecond = 0.0;
+    double nsPerCell = 0.0;
+    double p50Ms = 0.0; // Median tick
+    double p99Ms = 0.0;
+};
+
+static std::string toHex(uint64_t value) {
+    std::ostringstream out;
+    out << std::hex << std::setw(16) << std::setfill('0') << value;
+    return out.str();
+}
+
+// The settings a result depends on besides the code, a baseline is only comparable with the same ones
+static std::string describeRun(int width, int height, const BenchmarkOptions& options) {
+    return std::to_string(width) + "x" + std::to_string(height) + ", " + std::to_string(options.ticks) + " ticks (+"
+        + std::to_string(options.warmup) + " warmup), seed " + std::to_string(options.seed) + ", " + std::to_string(options.threads)
+        + (options.threads == 1 ? " thread" : " threads") + ", " + (options.margolus ? "Margolus" : "Moore")
+        + (options.velocity ? " with velocity" : "") + ", materials " + toHex(options.materialsHash);
+}
+
+static void printUsage() {
+    std::cout << "Usage: Benchmark [--ticks N] [--warmup N] [--repeat N] [--seed N] [--threads N] [--only name]" << std::endl;
+    std::cout << "                 [--json path] [--baseline path] [--tolerance percent] [--materials path] [--velocity] [--margolus]" << std::endl;
+}
+
+static bool parseArguments(int argc, char** argv, BenchmarkOptions& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--ticks" && hasValue) {
+            options.ticks = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (arg == "--warmup" && hasValue) {
+            options.warmup = std::max(0, std::atoi(argv[++i]));
+        }
+        else if (arg == "--repeat" && hasValue) {
+            options.repeat = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (arg == "--seed" && hasValue) {
+            options.seed = unsigned(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--threads" && hasValue) {
+            options.threads = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (arg == "--only" && hasValue) {
+            options.only = argv[++i];
+        }
+        else if (arg == "--json" && hasValue) {
+            options.json = argv[++i];
+        }
+        else if (arg == "--baseline" && hasValue) {
+            options.baseline = argv[++i];
+        }
+        else if (arg == "--tolerance" && hasValue) {
+            options.tolerance = std::max(0.0, std::atof(argv[++i]));
+        }
+        else if (arg == "--materials" && hasValue) {
+            options.materials = argv[++i];
+        }
+        else if (arg == "--velocity") {
+            options.velocity = true;
+        }
+        else if (arg == "--margolus") {
+            options.margolus = true;
+        }
+        else {
+            printUsage();
+            return false;
+        }
+    }
+    return true;
+}
+
+// Tick latency at fraction q of the sorted tick times
+static double percentile(const std::vector<double>& sorted, double q) {
+    size_t index = std::min(sorted.size() - 1, size_t(q * double(sorted.size() - 1) + 0.5));
+    return sorted[index];
+}
+
+// Build the scene from the seed, warm it up and time every measured tick on its own
+static SceneResult runScene(const Scenario& scenario, const BenchmarkOptions& options, std::vector<double>& tickMs) {
+    SetSimulationThreads(options.threads);
+    velocityMovement = options.velocity;
+    SetMovementNeighbourhood(options.margolus ? NeighborhoodType::Margolus : NeighborhoodType::Moore);
+    RandomDevice::reseed(options.seed);
+    InitializeSimulation();
+    scenario.build();
+    for (int i = 0; i < options.warmup; i++) {
+        UpdateParticles();
+    }
+
+    tickMs.clear();
+    double totalSeconds = 0.0;
+    for (int i = 0; i < options.ticks; i++) {
+        auto tickStart = std::chrono::steady_clock::now();
+        UpdateParticles();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - tickStart).count();
+        tickMs.push_back(seconds * 1000.0);
+        totalSeconds += seconds;
+    }
+    std::sort(tickMs.begin(), tickMs.end());
+
+    SceneResult result;
+    result.name = scenario.name;
+    result.ticksPerSecond = options.ticks / totalSeconds;
+    result.nsPerCell = totalSeconds * 1.0e9 / (double(grid.getWidth()) * grid.getHeight() * options.ticks);
+    result.p50Ms = percentile(tickMs, 0.50);
+    result.p99Ms = percentile(tickMs, 0.99);
+    return result;
+}
+
+static bool writeJson(const std::string& path, const BenchmarkOptions& options, const std::vector<SceneResult>& results) {
+    std::ofstream out(path);
+    if (!out) {
+        std::cerr << "Failed to create " << path << std::endl;
+        return false;
+    }
+    out << std::fixed << std::setprecision(4);
+    out << "{\n";
+    out << "  \"version\": " << BENCHMARK_FORMAT_VERSION << ",\n";
+    out << "  \"grid\": \"" << grid.getWidth() << "x" << grid.getHeight() << "\",\n";
+    out << "  \"ticks\": " << options.ticks << ",\n";
+    out << "  \"warmup\": " << options.warmup << ",\n";
+    out << "  \"seed\": " << options.seed << ",\n";
+    out << "  \"threads\": " << options.threads << ",\n";
+    out << "  \"velocity\": " << int(options.velocity) << ",\n";
+    out << "  \"margolus\": " << int(options.margolus) << ",\n";
+    out << "  \"materials\": \"" << toHex(options.materialsHash) << "\",\n";
+    out << "  \"scenes\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const SceneResult& result = results[i];
+        out << "    { \"name\": \"" << result.name << "\", \"ticks_per_sec\": " << result.ticksPerSecond << ", \"ns_per_cell\": " << result.nsPerCell
+            << ", \"p50_ms\": " << result.p50Ms << ", \"p99_ms\": " << result.p99Ms << " }" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n";
+    out << "}\n";
+
+    if (!out) {
+        std::cerr << "Failed to write " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// The number after "key": in text, searching from pos up to end
+static bool findNumber(const std::string& text, const std::string& key, size_t pos, size_t end, double& value) {
+    size_t found = text.find("\"" + key + "\":", pos);
+    if (found == std::string::npos || found >= end) {
+        return false;
+    }
+    char* numberEnd = nullptr;
+    const char* start = text.c_str() + found + key.size() + 3;
+    value = std::strtod(start, &numberEnd);
+    return numberEnd != start;
+}
+
+// Reads back what writeJson wrote, the settings of the run into recorded and one scene object per name
+static bool readBaseline(const std::string& path, std::string& recorded, std::vector<SceneResult>& baseline) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "Failed to open baseline " << path << std::endl;
+        return false;
+    }
+    std::stringstream buffer;
+    buffer << in.rdbuf();
+    std::string text = buffer.str();
+    text.erase(std::remove_if(text.begin(), text.end(), [](char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; }), text.end());
+
+    double version;
+    if (!findNumber(text, "version", 0, text.size(), version) || int(version) != BENCHMARK_FORMAT_VERSION) {
+        std::cerr << "Baseline " << path << " is not a version " << BENCHMARK_FORMAT_VERSION << " benchmark result" << std::endl;
+        return false;
+    }
+
+    // Everything before the scene list describes the run
+    size_t scenesStart = text.find("\"scenes\":");
+    const std::string gridKey = "\"grid\":\"";
+    size_t gridStart = text.find(gridKey);
+    const std::string materialsKey = "\"materials\":\"";
+    size_t materialsStart = text.find(materialsKey);
+    double ticks, warmup, seed, threads, velocity, margolus;
+    if (scenesStart == std::string::npos || gridStart == std::string::npos || gridStart > scenesStart
+        || materialsStart == std::string::npos || materialsStart > scenesStart
+        || !findNumber(text, "ticks", 0, scenesStart, ticks) || !findNumber(text, "warmup", 0, scenesStart, warmup)
+        || !findNumber(text, "seed", 0, scenesStart, seed) || !findNumber(text, "threads", 0, scenesStart, threads)
+        || !findNumber(text, "velocity", 0, scenesStart, velocity) || !findNumber(text, "margolus", 0, scenesStart, margolus)) {
+        std::cerr << "Baseline " << path << " doesn't record the settings it was run with" << std::endl;
+        return false;
+    }
+    gridStart += gridKey.size();
+    BenchmarkOptions run;
+    run.ticks = int(ticks);
+    run.warmup = int(warmup);
+    run.seed = unsigned(seed);
+    run.threads = int(threads);
+    run.velocity = velocity != 0.0;
+    run.margolus = margolus != 0.0;
+    run.materialsHash = std::strtoull(text.c_str() + materialsStart + materialsKey.size(), nullptr, 16);
+    int width = std::atoi(text.c_str() + gridStart);
+    size_t separator = text.find('x', gridStart);
+    int height = separator < scenesStart ? std::atoi(text.c_str() + separator + 1) : 0;
+    recorded = describeRun(width, height, run);
+
+    const std::string nameKey = "\"name\":\"";
+    for (size_t pos = text.find(nameKey); pos != std::string::npos; pos = text.find(nameKey, pos)) {
+        pos += nameKey.size();
+        size_t nameEnd = text.find('"', pos);
+        size_t objectEnd = text.find('}', pos);
+        SceneResult result;
+        result.name = text.substr(pos, nameEnd - pos);
+        if (nameEnd == std::string::npos || objectEnd == std::string::npos
+            || !findNumber(text, "ticks_per_sec", pos, objectEnd, result.ticksPerSecond) || !findNumber(text, "ns_per_cell", pos, objectEnd, result.nsPerCell)
+            || !findNumber(text, "p50_ms", pos, objectEnd, result.p50Ms) || !findNumber(text, "p99_ms", pos, objectEnd, result.p99Ms)) {
+            std::cerr << "Baseline " << path << " has a damaged scene entry" << std::endl;
+            return false;
+        }
+        baseline.push_back(result);
+    }
+    return true;
+}
+
+// Percent change from before to after, positive when after is larger
+static double percentChange(double before, double after) {
+    return before > 0.0 ? (after - before) * 100.0 / before : 0.0;
+}
+
+// Prints each scene against the baseline, returns the number of scenes that regressed
+// A scene regresses when its throughput drops or its p99 tick grows by more than the tolerance.
+static int compareBaseline(const std::vector<SceneResult>& results, const std::vector<SceneResult>& baseline, double tolerance) {
+    std::cout << std::endl << "scene             ticks/sec    change       p99 ms    change" << std::endl;
+    int regressions = 0;
+    for (const SceneResult& result : results) {
+        auto match = std::find_if(baseline.begin(), baseline.end(), [&](const SceneResult& entry) { return entry.name == result.name; });
+        if (match == baseline.end()) {
+            std::cout << std::left << std::setw(16) << result.name << std::right << "  not in the baseline" << std::endl;
+            continue;
+        }
+
+        double throughputChange = percentChange(match->ticksPerSecond, result.ticksPerSecond);
+        double p99Change = percentChange(match->p99Ms, result.p99Ms);
+        bool regressed = throughputChange < -tolerance || p99Change > tolerance;
+        regressions += regressed;
+
+        std::cout << std::left << std::setw(16) << result.name << std::right
+            << std::setw(12) << to_string_rounded(result.ticksPerSecond, 1) << std::setw(9) << to_string_rounded(throughputChange, 1) << "%"
+            << std::setw(13) << to_string_rounded(result.p99Ms, 4) << std::setw(9) << to_string_rounded(p99Change, 1) << "%"
+            << (regressed ? "  REGRESSION" : "") << std::endl;
+    }
+    return regressions;
+}
+
+int main(int argc, char** argv) {
+    BenchmarkOptions options;
+    if (!parseArguments(argc, argv, options)) {
+        return 1;
+    }
+
+    // Every scene has to exist before any time is spent running them
+    std::vector<const Scenario*> scenes;
+    for (const char* name : BENCHMARK_SCENES) {
+        if (options.only.empty() || options.only == name) {
+            scenes.push_back(findScenario(name));
+        }
+    }
+    if (scenes.empty() || std::find(scenes.begin(), scenes.end(), nullptr) != scenes.end()) {
+        std::cerr << "Unknown scene: " << options.only << std::endl;
+        return 1;
+    }
+
+    if (!LoadMaterials(options.materials)) {
+        return 1;
+    }
+    options.materialsHash = HashMaterialSet(getMaterialSet());
+
+    // A baseline of another kind of run would turn every difference in settings into a regression or a pass
+    std::vector<SceneResult> baseline;
+    if (!options.baseline.empty()) {
+        std::string recorded;
+        if (!readBaseline(options.baseline, recorded, baseline)) {
+            return 1;
+        }
+        std::string current = describeRun(DEFAULT_GRID_WIDTH, DEFAULT_GRID_HEIGHT, options);
+        if (recorded != current) {
+            std::cerr << "Baseline " << options.baseline << " was recorded with " << recorded << ", this run is " << current << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << "benchmark:     " << scenes.size() << " scenes, " << DEFAULT_GRID_WIDTH << "x" << DEFAULT_GRID_HEIGHT << ", " << options.ticks
+        << " ticks (+" << options.warmup << " warmup), best of " << options.repeat << ", seed " << options.seed << ", " << options.threads
+        << (options.threads == 1 ? " thread" : " threads") << std::endl;
+    std::cout << "scene             ticks/sec   ns/cell     p50 ms     p99 ms" << std::endl;
+
+    std::vector<SceneResult> results;
+    std::vector<double> tickMs;
+    tickMs.reserve(options.ticks);
+    for (const Scenario* scenario : scenes) {
+        // The fastest repeat is the one least disturbed by the rest of the machine
+        SceneResult best;
+        for (int run = 0; run < options.repeat; run++) {
+            SceneResult result = runScene(*scenario, options, tickMs);
+            if (result.ticksPerSecond > best.ticksPerSecond) {
+                best = result;
+            }
+        }
+        results.push_back(best);
+
+        std::cout << std::left << std::setw(16) << best.name << std::right
+            << std::setw(12) << to_string_rounded(best.ticksPerSecond, 1) << std::setw(10) << to_string_rounded(best.nsPerCell, 2)
+            << std::setw(11) << to_string_rounded(best.p50Ms, 4) << std::setw(11) << to_string_rounded(best.p99Ms, 4) << std::endl;
+    }
+
+    if (!options.json.empty() && !writeJson(options.json, options, results)) {
+        return 1;
+    }
+
+    if (!options.baseline.empty()) {
+        int regressions = compareBaseline(results, baseline, options.tolerance);
+        if (regressions > 0) {
+            std::cerr << regressions << (regressions == 1 ? " scene" : " scenes") << " regressed by more than " << options.tolerance << "%" << std::endl;
+            return EXIT_REGRESSION;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+// Turns elapsed wall time into a whole number of fixed-length steps
+// Leftover time carries over between calls, so steps come out at an even rate however unevenly advance is
+// called. When more than maxCatchUp steps are due at once the rest are dropped: a machine that can't keep
+// up runs slower instead of falling further behind with every step it takes.
+class FixedTimestep {
+public:
+    FixedTimestep(double stepSeconds, int maxCatchUp)
+        : stepSeconds(stepSeconds), maxCatchUp(std::max(maxCatchUp, 1)) {}
+
+    // Add elapsedSeconds and return how many steps to run now
+    int advance(double elapsedSeconds) {
+        accumulated += std::max(elapsedSeconds, 0.0);
+        int due = int(accumulated / stepSeconds);
+        if (due > maxCatchUp) {
+            droppedSteps += uint64_t(due - maxCatchUp);
+            due = maxCatchUp;
+            accumulated = stepSeconds * due; // Nothing owed beyond what's about to run
+        }
+        accumulated -= stepSeconds * due;
+        return due;
+    }
+
+    // Forget time owed, e.g. while paused
+    void reset() { accumulated = 0.0; }
+
+    double getStepSeconds() const { return stepSeconds; }
+    double secondsUntilNextStep() const { return std::max(stepSeconds - accumulated, 0.0); }
+
+    // Steps skipped because too many were due at once
+    uint64_t getDroppedSteps() const { return droppedSteps; }
+
+private:
+    double stepSeconds;
+    int maxCatchUp;
+    double accumulated = 0.0;
+    uint64_t droppedSteps = 0;
+};
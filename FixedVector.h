@@ -0,0 +1,86 @@
+#pragma once
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Vector with a fixed capacity stored inline, for small per-particle lists that must not allocate
+template<typename T, size_t Capacity>
+class FixedVector {
+public:
+    void push_back(const T& value) {
+        assert(count < Capacity);
+        items[count++] = value;
+    }
+
+    template<typename... Args>
+    void emplace_back(Args&&... args) {
+        assert(count < Capacity);
+        items[count++] = T(std::forward<Args>(args)...);
+    }
+
+    // Remove the element at it, keeping the order of the rest
+    T* erase(T* it) {
+        for (T* next = it + 1; next != end(); ++next) {
+            *(next - 1) = *next;
+        }
+        count--;
+        return it;
+    }
+
+    void clear() { count = 0; }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    static constexpr size_t capacity() { return Capacity; }
+
+    T& operator[](size_t i) { return items[i]; }
+    const T& operator[](size_t i) const { return items[i]; }
+
+    T* data() { return items.data(); }
+    const T* data() const { return items.data(); }
+
+    T* begin() { return items.data(); }
+    T* end() { return items.data() + count; }
+    const T* begin() const { return items.data(); }
+    const T* end() const { return items.data() + count; }
+
+private:
+    std::array<T, Capacity> items{};
+    size_t count = 0;
+};
+
+// Non-owning view of contiguous elements
+template<typename T>
+class Span {
+public:
+    Span() = default;
+    Span(T* data, size_t size) : first(data), count(size) {}
+
+    template<typename U, size_t Capacity>
+    Span(FixedVector<U, Capacity>& values) : first(values.data()), count(values.size()) {}
+
+    template<typename U, size_t Capacity>
+    Span(const FixedVector<U, Capacity>& values) : first(values.data()), count(values.size()) {}
+
+    template<typename U>
+    Span(std::vector<U>& values) : first(values.data()), count(values.size()) {}
+
+    template<typename U>
+    Span(const std::vector<U>& values) : first(values.data()), count(values.size()) {}
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    T& operator[](size_t i) const { return first[i]; }
+
+    T* data() const { return first; }
+    T* begin() const { return first; }
+    T* end() const { return first + count; }
+
+private:
+    T* first = nullptr;
+    size_t count = 0;
+};
@@ -0,0 +1,299 @@
+#include "FrameExporter.h"
+
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+
+// PNG needs a zlib stream, stored (uncompressed) deflate blocks keep the encoder trivial and fast
+// Files come out a little larger than the raw pixels, compressing them is left to whatever reads them.
+const size_t DEFLATE_STORED_BLOCK = 65535;
+
+static const std::array<uint32_t, 256>& crcTable() {
+    static const std::array<uint32_t, 256> table = [] {
+        std::array<uint32_t, 256> values;
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            values[n] = c;
+        }
+        return values;
+    }();
+    return table;
+}
+
+static uint32_t crc32(const unsigned char* bytes, size_t count) {
+    const std::array<uint32_t, 256>& table = crcTable();
+    uint32_t c = 0xFFFFFFFFu;
+    for (size_t i = 0; i < count; i++) {
+        c = table[(c ^ bytes[i]) & 0xFF] ^ (c >> 8);
+    }
+    return c ^ 0xFFFFFFFFu;
+}
+
+static unsigned char* putBigEndian(unsigned char* out, uint32_t value) {
+    out[0] = uint8_t(value >> 24);
+    out[1] = uint8_t(value >> 16);
+    out[2] = uint8_t(value >> 8);
+    out[3] = uint8_t(value);
+    return out + 4;
+}
+
+// Bytes of one filtered PNG image: a filter byte and the RGBA8 pixels of every row
+static size_t pngImageBytes(int width, int height) {
+    return size_t(height) * (1 + size_t(width) * 4);
+}
+
+// Whole file: signature, IHDR, IDAT (zlib header, stored blocks with a 5 byte header each, adler32), IEND
+static size_t pngFileBytes(int width, int height) {
+    size_t image = pngImageBytes(width, height);
+    size_t blocks = (image + DEFLATE_STORED_BLOCK - 1) / DEFLATE_STORED_BLOCK;
+    return 8 + (12 + 13) + (12 + 2 + image + 5 * blocks + 4) + 12;
+}
+
+// Writes the image as a zlib stream of stored deflate blocks, keeping the adler32 as it goes
+class StoredDeflateWriter {
+public:
+    StoredDeflateWriter(unsigned char* out, size_t totalBytes) : out(out), remaining(totalBytes) {
+        *this->out++ = 0x78; // Deflate, 32K window
+        *this->out++ = 0x01; // No preset dictionary, fastest
+    }
+
+    void write(const unsigned char* bytes, size_t count) {
+        while (count > 0) {
+            if (blockLeft == 0) {
+                blockLeft = std::min(remaining, DEFLATE_STORED_BLOCK);
+                remaining -= blockLeft;
+                *out++ = remaining == 0 ? 1 : 0; // BFINAL on the last block, BTYPE 00
+                *out++ = uint8_t(blockLeft);
+                *out++ = uint8_t(blockLeft >> 8);
+                *out++ = uint8_t(~blockLeft);
+                *out++ = uint8_t(~blockLeft >> 8);
+            }
+
+            size_t take = std::min(count, blockLeft);
+            std::memcpy(out, bytes, take);
+            updateAdler(bytes, take);
+            out += take;
+            bytes += take;
+            count -= take;
+            blockLeft -= take;
+        }
+    }
+
+    unsigned char* finish() {
+        return putBigEndian(out, (adlerB << 16) | adlerA);
+    }
+
+private:
+    void updateAdler(const unsigned char* bytes, size_t count) {
+        // 5552 bytes is the most that can be summed before the modulo without overflowing 32 bits
+        while (count > 0) {
+            size_t run = std::min(count, size_t(5552));
+            for (size_t i = 0; i < run; i++) {
+                adlerA += bytes[i];
+                adlerB += adlerA;
+            }
+            adlerA %= 65521;
+            adlerB %= 65521;
+            bytes += run;
+            count -= run;
+        }
+    }
+
+    unsigned char* out;
+    size_t remaining;
+    size_t blockLeft = 0;
+    uint32_t adlerA = 1;
+    uint32_t adlerB = 0;
+};
+
+FrameExporter::FrameExporter(int width, int height, ExportFormat format, const std::string& path, int bufferCount)
+    : width(width), height(height), format(format), path(path) {
+    slots.resize(size_t(std::max(bufferCount, 1)));
+    for (Slot& slot : slots) {
+        slot.pixels.resize(size_t(width) * height);
+    }
+    rowBytes.resize(size_t(width) * 4);
+
+    if (format == ExportFormat::RAW) {
+        rawFile = std::fopen(path.c_str(), "wb");
+        if (rawFile == nullptr) {
+            std::cerr << "Failed to open " << path << " for frame export" << std::endl;
+            return;
+        }
+    }
+    else {
+        std::error_code error;
+        std::filesystem::create_directories(path, error);
+        if (error) {
+            std::cerr << "Failed to create " << path << " for frame export: " << error.message() << std::endl;
+            return;
+        }
+
+        encoded.resize(pngFileBytes(width, height));
+        fileName.resize(path.size() + 32);
+        crcTable();
+    }
+
+    open = true;
+    writer = std::thread(&FrameExporter::writerLoop, this);
+}
+
+bool FrameExporter::submit(const CellFramebuffer& frame, uint32_t tick) {
+    assert(frame.getWidth() == width && frame.getHeight() == height);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.submitted++;
+        if (!open || nextToQueue - nextToWrite >= slots.size()) {
+            stats.dropped++;
+            return false;
+        }
+    }
+
+    // The writer never touches this slot until nextToQueue moves past it
+    Slot& slot = slots[nextToQueue % slots.size()];
+    std::memcpy(slot.pixels.data(), frame.getPixels(), slot.pixels.size() * sizeof(uint32_t));
+    slot.tick = tick;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        nextToQueue++;
+        stats.maxQueued = std::max(stats.maxQueued, int(nextToQueue - nextToWrite));
+    }
+    wake.notify_one();
+    return true;
+}
+
+void FrameExporter::finish() {
+    if (writer.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        writer.join();
+    }
+
+    if (rawFile != nullptr) {
+        std::fclose(rawFile);
+        rawFile = nullptr;
+    }
+}
+
+ExportStats FrameExporter::getStats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+void FrameExporter::writerLoop() {
+    while (true) {
+        uint64_t frame;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this] { return stopping || nextToWrite != nextToQueue; });
+            if (nextToWrite == nextToQueue) {
+                return; // Stopping with nothing left to write
+            }
+            frame = nextToWrite;
+        }
+
+        writeFrame(slots[frame % slots.size()]);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        nextToWrite++;
+    }
+}
+
+// Row y of the frame as RGBA8 bytes in rowBytes, alpha forced opaque
+void FrameExporter::convertRow(const Slot& slot, int y) {
+    const uint32_t* pixels = &slot.pixels[size_t(y) * width];
+    for (int x = 0; x < width; x++) {
+        uint32_t pixel = pixels[x] | 0xFF000000u;
+        std::memcpy(&rowBytes[size_t(x) * 4], &pixel, 4);
+    }
+}
+
+size_t FrameExporter::encodePNG(const Slot& slot) {
+    static const unsigned char SIGNATURE[8] = { 137, 'P', 'N', 'G', '\r', '\n', 26, '\n' };
+
+    unsigned char* out = encoded.data();
+    std::memcpy(out, SIGNATURE, sizeof(SIGNATURE));
+    out += sizeof(SIGNATURE);
+
+    // IHDR: 8 bit RGBA, no interlacing
+    unsigned char* chunk = out;
+    out = putBigEndian(out, 13);
+    std::memcpy(out, "IHDR", 4);
+    out = putBigEndian(out + 4, uint32_t(width));
+    out = putBigEndian(out, uint32_t(height));
+    const unsigned char imageType[5] = { 8, 6, 0, 0, 0 }; // Bit depth, color type, compression, filter, interlace
+    std::memcpy(out, imageType, sizeof(imageType));
+    out += sizeof(imageType);
+    out = putBigEndian(out, crc32(chunk + 4, size_t(out - chunk - 4)));
+
+    chunk = out;
+    out += 4; // Length, filled in below
+    std::memcpy(out, "IDAT", 4);
+    out += 4;
+
+    // Every row starts with filter type 0 (none), rows go top-down while the framebuffer is bottom-up
+    StoredDeflateWriter deflate(out, pngImageBytes(width, height));
+    const unsigned char filter = 0;
+    for (int y = height - 1; y >= 0; y--) {
+        convertRow(slot, y);
+        deflate.write(&filter, 1);
+        deflate.write(rowBytes.data(), rowBytes.size());
+    }
+    out = deflate.finish();
+
+    putBigEndian(chunk, uint32_t(out - chunk - 8));
+    out = putBigEndian(out, crc32(chunk + 4, size_t(out - chunk - 4)));
+
+    chunk = out;
+    out = putBigEndian(out, 0);
+    std::memcpy(out, "IEND", 4);
+    out += 4;
+    out = putBigEndian(out, crc32(chunk + 4, 4));
+
+    return size_t(out - encoded.data());
+}
+
+void FrameExporter::writeFrame(const Slot& slot) {
+    auto encodeStart = std::chrono::steady_clock::now();
+    bool ok = true;
+    double encodeSeconds = 0.0;
+
+    if (format == ExportFormat::RAW) {
+        for (int y = height - 1; y >= 0 && ok; y--) {
+            convertRow(slot, y);
+            ok = std::fwrite(rowBytes.data(), 1, rowBytes.size(), rawFile) == rowBytes.size();
+        }
+    }
+    else {
+        size_t bytes = encodePNG(slot);
+        encodeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - encodeStart).count();
+
+        std::snprintf(fileName.data(), fileName.size(), "%s/frame_%06u.png", path.c_str(), unsigned(slot.tick));
+        FILE* file = std::fopen(fileName.data(), "wb");
+        ok = file != nullptr && std::fwrite(encoded.data(), 1, bytes, file) == bytes;
+        if (file != nullptr) {
+            ok = std::fclose(file) == 0 && ok;
+        }
+    }
+
+    double totalSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - encodeStart).count();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (ok) {
+        stats.written++;
+    }
+    else {
+        stats.failed++;
+    }
+    stats.encodeSeconds += encodeSeconds;
+    stats.writeSeconds += totalSeconds - encodeSeconds;
+}
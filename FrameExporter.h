@@ -0,0 +1,84 @@
+#pragma once
+
+#include "Framebuffer.h"
+
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+
+enum class ExportFormat {
+    PNG, // One frame_<tick>.png per frame in the output directory
+    RAW, // Every frame appended to one file as top-down RGBA8, e.g. ffmpeg -f rawvideo -pix_fmt rgba -s WxH
+};
+
+// Totals since the exporter started
+struct ExportStats {
+    int submitted = 0;
+    int written = 0;
+    int dropped = 0; // Submitted while every buffer was still queued
+    int failed = 0; // Couldn't be written to disk
+    int maxQueued = 0; // Most frames waiting at once
+    double encodeSeconds = 0.0;
+    double writeSeconds = 0.0;
+};
+
+// Writes framebuffer copies to disk on a background thread
+// submit copies the pixels into one of a fixed ring of buffers and returns straight away, the writer thread
+// encodes and writes them in order. When every buffer is still waiting the frame is dropped rather than
+// making the caller wait, so the simulation never blocks on the disk. Buffers, the encode buffer and the
+// writer thread are all set up front, submitting and writing frames doesn't allocate.
+// Frames are written opaque (empty cells black), like the window shows them.
+class FrameExporter {
+public:
+    FrameExporter(int width, int height, ExportFormat format, const std::string& path, int bufferCount);
+    ~FrameExporter() { finish(); }
+
+    FrameExporter(const FrameExporter&) = delete;
+    FrameExporter& operator=(const FrameExporter&) = delete;
+
+    // Whether the output could be opened
+    bool isOpen() const { return open; }
+
+    // Queue a copy of frame, labelled with tick, returns false if it was dropped
+    bool submit(const CellFramebuffer& frame, uint32_t tick);
+
+    // Write everything still queued and stop the writer thread
+    void finish();
+
+    ExportStats getStats();
+
+private:
+    struct Slot {
+        std::vector<uint32_t> pixels;
+        uint32_t tick = 0;
+    };
+
+    void writerLoop();
+    void writeFrame(const Slot& slot);
+    void convertRow(const Slot& slot, int y);
+    size_t encodePNG(const Slot& slot);
+
+    int width;
+    int height;
+    ExportFormat format;
+    std::string path;
+    bool open = false;
+
+    std::vector<Slot> slots;
+    // Only touched by the writer thread
+    std::vector<unsigned char> encoded;
+    std::vector<unsigned char> rowBytes;
+    std::vector<char> fileName;
+    FILE* rawFile = nullptr;
+
+    // Frames [nextToWrite, nextToQueue) are waiting, frame i in slots[i % slots.size()]
+    std::mutex mutex;
+    std::condition_variable wake;
+    uint64_t nextToQueue = 0;
+    uint64_t nextToWrite = 0;
+    bool stopping = false;
+    ExportStats stats;
+
+    std::thread writer;
+};
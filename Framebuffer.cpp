@@ -0,0 +1,57 @@
+#include "Framebuffer.h"
+
+#include <cstring>
+#include <fstream>
+
+CellFramebuffer::CellFramebuffer(const Grid& source)
+    : width(source.getWidth()), height(source.getHeight()),
+      pixels(size_t(width) * height, 0), rowParticleCounts(size_t(height), 0) {}
+
+CellFramebuffer::RowRange CellFramebuffer::refresh(Grid& source) {
+    RowRange changed;
+    changed.first = height;
+
+    // The first refresh copies everything, rows written before the framebuffer existed aren't flagged any more
+    bool copyAll = !filled;
+    filled = true;
+
+    const uint32_t* colors = source.colorPlane();
+    for (int y = 0; y < height; y++) {
+        if (!source.takeRowChanged(y) && !copyAll) {
+            continue;
+        }
+
+        size_t row = source.index(0, y);
+        std::memcpy(&pixels[size_t(y) * width], colors + row, size_t(width) * sizeof(uint32_t));
+
+        int count = source.countRowParticles(y);
+        particleCount += count - rowParticleCounts[y];
+        rowParticleCounts[y] = count;
+
+        changed.first = std::min(changed.first, y);
+        changed.last = y + 1;
+    }
+    return changed;
+}
+
+bool CellFramebuffer::writePPM(const std::string& path) const {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out << "P6\n" << width << " " << height << "\n255\n";
+
+    std::vector<unsigned char> row(size_t(width) * 3);
+    for (int y = height - 1; y >= 0; y--) {
+        for (int x = 0; x < width; x++) {
+            uint32_t pixel = pixels[size_t(y) * width + x];
+            row[size_t(x) * 3 + 0] = uint8_t(pixel);
+            row[size_t(x) * 3 + 1] = uint8_t(pixel >> 8);
+            row[size_t(x) * 3 + 2] = uint8_t(pixel >> 16);
+        }
+        out.write(reinterpret_cast<const char*>(row.data()), std::streamsize(row.size()));
+    }
+
+    if (!out) {
+        std::cerr << "Failed to write " << path << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "Game.h"
+
+// CPU copy of what the grid looks like, one RGBA8 pixel per cell
+// Pixels are the packed particle colors (red in the lowest byte), so a row can be handed to GL as
+// GL_RGBA / GL_UNSIGNED_BYTE without conversion. Row 0 is the bottom of the world, like the grid and like
+// texture coordinates. Empty cells are 0, transparent black.
+class CellFramebuffer {
+public:
+    // Sized to match source, refresh it from that grid
+    explicit CellFramebuffer(const Grid& source);
+
+    // Rows [first, last) changed by the last refresh, empty when first == last
+    struct RowRange {
+        int first = 0;
+        int last = 0;
+
+        bool empty() const { return first >= last; }
+    };
+
+    // Copy every row the grid wrote since the last refresh, returns the span of rows that changed
+    // The row flags live in the grid, so only one framebuffer should refresh from a grid
+    RowRange refresh(Grid& source);
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    const uint32_t* getPixels() const { return pixels.data(); }
+
+    // Non-empty cells as of the last refresh, popcounted per row from the grid's occupancy so only changed rows get recounted
+    int getParticleCount() const { return particleCount; }
+
+    // Binary PPM (P6), top row first, alpha dropped. Returns false and prints why on failure
+    bool writePPM(const std::string& path) const;
+
+private:
+    int width;
+    int height;
+    std::vector<uint32_t> pixels;
+    std::vector<int> rowParticleCounts;
+    int particleCount = 0;
+    bool filled = false;
+};
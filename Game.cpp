@@ -1,2 +1,1295 @@
 #include "Game.h"
+#include "HeatSolver.h"
+#include "Margolus.h"
+#include "Materials.h"
+#include "Profiler.h"
+#include "ScratchArena.h"
+#include "ThreadPool.h"
 
+// Function to sample from a range based on weighted probabilities
+int sampleFromProbabilities(Span<const float> probabilities) {
+    if (probabilities.empty()) return -1; // Early exit if the input is empty
+
+    // Step 1: Compute the total sum of probabilities
+    float totalProbability = std::accumulate(probabilities.begin(), probabilities.end(), 0.0f);
+
+    // Step 2: Generate a random number within the range of the total probability
+    float randomValue = SimRandom::range(0.0f, totalProbability);
+
+    // Step 3: Iterate through the probabilities to find the correct index
+    float cumulativeSum = 0.0f;
+    for (size_t i = 0; i < probabilities.size(); ++i) {
+        cumulativeSum += probabilities[i];
+        if (randomValue <= cumulativeSum) {
+            return static_cast<int>(i);
+        }
+    }
+
+    return -1; // Should never reach here if probabilities are correctly normalized
+}
+
+// Softmax function for normalization
+std::vector<float> altsoftmax(const std::vector<float>& weights) {
+    std::vector<float> probabilities(weights.size());
+
+    float sum = 0.0f;
+
+    // Calculate exponentials and sum them up
+    for (size_t i = 0; i < weights.size(); ++i) {
+        sum += weights[i];
+    }
+
+    // Normalize by dividing by the sum
+    for (size_t i = 0; i < weights.size(); ++i) {
+        if (weights[i] > 0) {
+            probabilities[i] = weights[i] / sum;
+        }
+        else {
+            probabilities[i] = 0.0f;  // Assign zero probability for zero weight
+        }
+    }
+
+    return probabilities;
+}
+
+float smoothstep(float edge0, float edge1, float x) {
+    // Scale, bias and saturate x to 0..1 range
+    x = std::clamp((x - edge0) / (edge1 - edge0), 0.0f, 1.0f);
+    // Evaluate polynomial
+    return x * x * (3 - 2 * x);
+}
+
+std::vector<float> interpolateWeights(ParticleState state, float density) {
+    std::vector<std::vector<float>> weights;
+
+    // Define weight templates
+    std::vector<std::vector<float>> solid_weights = {
+        { 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f }, // Extremely light materials
+        { 1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f }, // Very light materials
+        { 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f }, // Light materials
+        { 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f }, // Neutrally buoyant materials
+        { 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f }, // Slightly dense materials
+        { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f }, // Very dense materials
+        { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f }  // Extremely dense materials
+    };
+    std::vector<std::vector<float>> powder_weights = {
+        { 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f }, // Extremely light materials
+        { 1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f }, // Very light materials
+        { 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f }, // Light materials
+        { 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f }, // Neutrally buoyant materials
+        { 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f }, // Slightly dense materials
+        { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f }, // Very dense materials
+        { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f }  // Extremely dense materials
+    };
+    std::vector<std::vector<float>> fluid_weights = {
+        { 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f }, // Extremely light materials
+        { 1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f }, // Very light materials
+        { 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f }, // Light materials
+        { 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f }, // Neutrally buoyant materials
+        { 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f }, // Slightly dense materials
+        { 0.0f, 0.0f, 0.0f, 0.1f, 0.1f, 1.0f, 1.0f, 1.0f }, // Very dense materials
+        { 0.0f, 0.0f, 0.0f, 0.0001f, 0.0001f, 1.0f, 0.1f, 0.1f }  // Extremely dense materials
+    };
+    std::vector<std::vector<float>> gas_weights = {
+        { 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f }, // Extremely light materials
+        { 1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f }, // Very light materials
+        { 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f }, // Light materials
+        { 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f }, // Neutrally buoyant materials
+        { 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f }, // Slightly dense materials
+        { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f }, // Very dense materials
+        { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f }  // Extremely dense materials
+    };
+    std::vector<std::vector<float>> plasma_weights = {
+        { 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f }, // Extremely light materials
+        { 1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f }, // Very light materials
+        { 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f }, // Light materials
+        { 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f }, // Neutrally buoyant materials
+        { 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f }, // Slightly dense materials
+        { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f }, // Very dense materials
+        { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f }  // Extremely dense materials
+    };
+
+    if (state == ParticleState::SOLID) {
+        weights = solid_weights;
+    }
+    else if (state == ParticleState::POWDER) {
+        weights = powder_weights;
+    }
+    else if (state == ParticleState::FLUID) {
+        weights = fluid_weights;
+    }
+    else if (state == ParticleState::GAS) {
+        weights = gas_weights;
+    }
+    else if (state == ParticleState::PLASMA) {
+        weights = plasma_weights;
+    }
+
+    // Initialize finalWeights with zeros
+    std::vector<float> finalWeights(8, 0.0f);
+
+    // Interpolation logic based on density
+    if (density < 0.01f) { // Extremely light materials
+        finalWeights = weights[0];
+    }
+    else if (density < 0.25f) { // Very light materials
+        float t = smoothstep(0.01f, 0.25f, density);
+        for (size_t i = 0; i < finalWeights.size(); ++i) {
+            finalWeights[i] = (1 - t) * weights[0][i] + t * weights[1][i];
+        }
+    }
+    else if (density < 1.0f) { // Light materials
+        float t = smoothstep(0.25f, 1.0f, density);
+        for (size_t i = 0; i < finalWeights.size(); ++i) {
+            finalWeights[i] = (1 - t) * weights[1][i] + t * weights[2][i];
+        }
+    }
+    else if (density < 1.2f) { // Neutrally buoyant materials
+        float t = smoothstep(1.0f, 1.2f, density);
+        for (size_t i = 0; i < finalWeights.size(); ++i) {
+            finalWeights[i] = (1 - t) * weights[2][i] + t * weights[3][i];
+        }
+    }
+    else if (density < 1.4f) { // Neutrally buoyant materials
+        float t = smoothstep(1.2f, 1.4f, density);
+        for (size_t i = 0; i < finalWeights.size(); ++i) {
+            finalWeights[i] = (1 - t) * weights[3][i] + t * weights[4][i];
+        }
+    }
+    else if (density < 1000.0f) { // Slightly dense materials
+        float t = smoothstep(1.4f, 1000.0f, density);
+        for (size_t i = 0; i < finalWeights.size(); ++i) {
+            finalWeights[i] = (1 - t) * weights[4][i] + t * weights[5][i];
+        }
+    }
+    else if (density < 2000.0f) { // Very dense materials
+        float t = smoothstep(1000.0f, 2000.0f, density);
+        for (size_t i = 0; i < finalWeights.size(); ++i) {
+            finalWeights[i] = (1 - t) * weights[5][i] + t * weights[6][i];
+        }
+    }
+    else { // Extremely dense materials
+        finalWeights = weights[6];
+    }
+
+    return finalWeights;
+}
+
+// Function to get movement directions based on density
+// Movement only ever uses the 8 Moore directions, so a particle has at most 8 tiers of at most 8 directions
+const size_t MAX_MOVE_DIRECTIONS = 8;
+
+std::vector<std::pair<float, std::vector<std::pair<int, int>>>> getMovementDirectionsFromDensity(ParticleState state, float density) {
+    // Define movement directions
+    std::vector<std::pair<int, int>> directions = {
+        {0, 1}, {-1, 1}, {1, 1}, // Upwards directions
+        {-1, 0}, {1, 0},         // Horizontal directions
+        {0, -1}, {-1, -1}, {1, -1} // Downwards directions
+    };
+
+    std::vector<float> finalWeights = interpolateWeights(state, density);
+
+    // Calculate probabilities using softmax
+    std::vector<float> probabilities = altsoftmax(finalWeights);
+
+    // Create a vector to hold directions with their probabilities
+    std::vector<std::tuple<int, int, float>> directionProbabilities;
+
+    // Assign directions and probabilities to each direction
+    for (size_t i = 0; i < directions.size(); ++i) {
+        if (probabilities[i] > 0) {
+            directionProbabilities.emplace_back(directions[i].first, directions[i].second, probabilities[i]);
+        }
+    }
+
+    // Sort the directionProbabilities by probabilities in descending order
+    std::sort(directionProbabilities.begin(), directionProbabilities.end(),
+        [](const std::tuple<int, int, float>& a, const std::tuple<int, int, float>& b) {
+            return std::get<2>(a) > std::get<2>(b);
+        });
+
+    // Group the sorted directions into tiers based on identical probabilities
+    std::pair<float, std::vector<std::pair<int, int>>> currentTier;
+    float currentProbability = std::get<2>(directionProbabilities[0]);
+
+
+    std::vector<std::pair<float, std::vector<std::pair<int, int>>>> movementDirectionsT;
+    for (const std::tuple<int, int, float>& direction : directionProbabilities) {
+        float prob = std::get<2>(direction);
+        if (prob == currentProbability) {
+            // Same probability, add to the current tier
+            currentTier.first += prob;
+            currentTier.second.push_back({ std::get<0>(direction), std::get<1>(direction) });
+        }
+        else {
+            // New probability tier, add the current tier to movementDirections and start a new tier
+            movementDirectionsT.push_back(currentTier);
+            currentTier.first = 0;
+            currentTier.second.clear();
+            currentTier.first += prob;
+            currentTier.second.push_back({ std::get<0>(direction), std::get<1>(direction) });
+            currentProbability = prob;
+        }
+    }
+
+    // Add the last tier to movementDirections
+    if (!currentTier.second.empty()) {
+        movementDirectionsT.push_back(currentTier);
+    }
+
+    std::vector<std::pair<float, std::vector<std::pair<int, int>>>> movementDirections = movementDirectionsT;
+    return movementDirections;
+}
+
+// One entry per material, filled by InitializeParticleTable
+std::array<generalParticleData, size_t(MAX_MATERIALS)> particleTable;
+int materialCount = 0;
+
+std::array<AlchemicReaction, size_t(MAX_MATERIALS) * MAX_MATERIALS> interactionMatrix;
+std::vector<AlchemicReaction> multiReactions;
+std::vector<Emission> materialEmissions;
+
+AlchemicReaction& getReaction(ParticleType type, uint32_t order) {
+    const generalParticleData& data = getMaterial(type);
+    for (uint32_t r = 0; r < data.multiReactionCount; r++) {
+        if (multiReactions[data.firstMultiReaction + r].order == order) {
+            return multiReactions[data.firstMultiReaction + r];
+        }
+    }
+    for (uint32_t bits = data.reactiveNeighbours; bits != 0; bits &= bits - 1) {
+        AlchemicReaction& reaction = interactionMatrix[size_t(type) * MAX_MATERIALS + lowestBit(bits)];
+        if (reaction.order == order) {
+            return reaction;
+        }
+    }
+    static AlchemicReaction none;
+    return none;
+}
+
+// Create a grid to store particles
+Grid grid(DEFAULT_GRID_WIDTH, DEFAULT_GRID_HEIGHT);
+
+// Function to get neighbors using Moore neighborhood
+Neighbourhood getMooreNeighbours(std::pair<int, int> pos) {
+    Neighbourhood neighbors;
+
+    // Moore neighborhood (radius 1)
+    int startX = pos.first - 1;
+    int startY = pos.second - 1;
+    int endX = pos.first + 1;
+    int endY = pos.second + 1;
+
+    for (int x = startX; x <= endX; ++x) {
+        for (int y = startY; y <= endY; ++y) {
+            // Skip the center point
+            if (x == pos.first && y == pos.second) continue;
+
+            // Check if the index is valid
+            if (isValidIndex(x, y)) {
+                neighbors.emplace_back(x, y);
+            }
+        }
+    }
+
+    return neighbors;
+}
+
+// Function to get neighbors using Margolus neighborhood
+Neighbourhood getMargolusNeighbours(std::pair<int, int> pos) {
+    Neighbourhood neighbors;
+
+    // Margolus neighborhood (2x2 block)
+    int blockX = (pos.first / 2) * 2;  // Align to the nearest even x
+    int blockY = (pos.second / 2) * 2; // Align to the nearest even y
+
+    // Depending on the position's offset within the block, define the neighborhood
+    static const std::pair<int, int> blockOffsets[] = {
+        {0, 0}, {0, 1}, {1, 0}, {1, 1}
+    };
+
+    for (const auto& offset : blockOffsets) {
+        int neighborX = blockX + offset.first;
+        int neighborY = blockY + offset.second;
+
+        // Skip the center point
+        if (neighborX == pos.first && neighborY == pos.second) continue;
+
+        // Check if the index is valid
+        if (isValidIndex(neighborX, neighborY)) {
+            neighbors.emplace_back(neighborX, neighborY);
+        }
+    }
+
+    return neighbors;
+}
+
+void transferParticleData(std::pair<int, int> pos, Particle newParticle, bool copySourceTemp) {
+    if (copySourceTemp) {
+        newParticle.temperature = grid.temperature(pos.first, pos.second);
+        //newParticle.temperature = std::max(newParticle.temperature, grid.temperature(pos.first, pos.second));
+    }
+
+    grid.set(pos.first, pos.second, newParticle);
+}
+
+void performSpecialActions(const std::vector<SpecialAction>& _specialActions, std::pair<int, int> pos) {
+    ParticleType type = grid.type(pos.first, pos.second);
+
+    for (SpecialAction action : _specialActions) {
+        action(pos);
+
+        // Stop once an action has turned this particle into something else
+        if (grid.type(pos.first, pos.second) != type) {
+            break;
+        }
+    }
+}
+
+Neighbourhood getNeighbours(std::pair<int, int> pos, NeighborhoodType type) {
+    if (type == NeighborhoodType::Moore) {
+        return getMooreNeighbours(pos);
+    }
+    else if (type == NeighborhoodType::Margolus) {
+        return getMargolusNeighbours(pos);
+    }
+    else {
+        std::cerr << "Unknown neighborhood type!" << std::endl;
+        return {};
+    }
+}
+
+void checkAlchemyReactions(std::pair<int, int> pos) {
+    ParticleType type = grid.type(pos.first, pos.second);
+    const generalParticleData& data = getMaterial(type);
+    uint32_t neighbourTypes = grid.neighbourTypes(pos.first, pos.second);
+
+    // One roll per reaction, drawn in a single batch and indexed by reaction order
+    ScratchArena::Frame frame;
+    Span<double> rolls = ScratchArena::local().allocate<double>(data.reactionCount);
+    SimRandom::fill(rolls.data(), rolls.size());
+
+    // Of the reactions with every prerequisite next to this particle, the first in order that passes its roll happens
+    const AlchemicReaction* happening = nullptr;
+    auto roll = [&](const AlchemicReaction& reaction) {
+        if (rolls[reaction.order] < reaction.halflife && (happening == nullptr || reaction.order < happening->order)) {
+            happening = &reaction;
+        }
+    };
+
+    // Single prerequisites straight from the matrix, one entry per neighbour type that reacts
+    uint32_t reacting = neighbourTypes & data.reactiveNeighbours;
+    bool couldReact = reacting != 0;
+    for (uint32_t bits = reacting; bits != 0; bits &= bits - 1) {
+        roll(getInteraction(type, ParticleType(lowestBit(bits))));
+    }
+
+    for (uint32_t r = 0; r < data.multiReactionCount; r++) {
+        const AlchemicReaction& reaction = multiReactions[data.firstMultiReaction + r];
+        if ((neighbourTypes & reaction.prerequisiteMask) == reaction.prerequisiteMask) {
+            couldReact = true;
+            roll(reaction);
+        }
+    }
+
+    if (happening != nullptr) {
+        PROFILE_COUNT(REACTIONS);
+        double resultTemp = happening->resultTemp;
+        transferParticleData(pos, Particle(happening->resultType));
+        if (resultTemp != -1) {
+            double& temperature = grid.temperature(pos.first, pos.second);
+            temperature = std::max(SimRandom::roughly(resultTemp, 0.1), temperature);
+        }
+        return;
+    }
+
+    // A reaction that only failed its roll can still happen, so don't let this chunk sleep
+    if (couldReact) {
+        grid.chunks.markDirty(pos.first, pos.second);
+    }
+}
+
+void attemptEmissions(std::pair<int, int> pos) {
+    // Nothing can be emitted without an empty cell next to this one
+    if (!(grid.neighbourTypes(pos.first, pos.second) & typeBit(ParticleType::EMPTY))) {
+        return;
+    }
+
+    const generalParticleData& data = getMaterial(grid.type(pos.first, pos.second));
+    Neighbourhood neighbors = getNeighbours(pos);
+    Neighbourhood emptyNeighbors;
+    for (std::pair<int, int> neighborPos : neighbors) {
+        if (grid.type(neighborPos.first, neighborPos.second) == ParticleType::EMPTY) {
+            emptyNeighbors.push_back(neighborPos);
+        }
+    }
+
+    // Keep emitting into free space even while nothing else around changes
+    if (!emptyNeighbors.empty()) {
+        grid.chunks.markDirty(pos.first, pos.second);
+    }
+
+    // Shuffle a scratch copy so the shared table stays untouched
+    ScratchArena::Frame frame;
+    Span<Emission> emissions = ScratchArena::local().copy<Emission>(
+        Span<const Emission>(materialEmissions.data() + data.firstEmission, data.emissionCount));
+
+    SimRandom::shuffle(emissions.begin(), emissions.end());
+
+    for (const Emission& emission : emissions) {
+        if (emptyNeighbors.empty()) {
+            break;
+        }
+
+        if (SimRandom::range(0.0, 1.0) < emission.halflife) {
+            int randomIndex = SimRandom::index(int(emptyNeighbors.size()));
+            grid.set(emptyNeighbors[randomIndex].first, emptyNeighbors[randomIndex].second, Particle(emission.type));
+            PROFILE_COUNT(EMISSIONS);
+        }
+    }
+}
+
+void clone(std::pair<int, int> pos) {
+    ParticleType& rememberedParticleType = grid.rememberedType(pos.first, pos.second);
+
+    // With nowhere to clone into, or nothing around to pick up and clone, there's nothing to do
+    uint32_t neighbourTypes = grid.neighbourTypes(pos.first, pos.second);
+    uint32_t emptyBit = typeBit(ParticleType::EMPTY);
+    if (rememberedParticleType != ParticleType::EMPTY ? !(neighbourTypes & emptyBit)
+        : !(neighbourTypes & ~(emptyBit | typeBit(ParticleType::CLONE)))) {
+        return;
+    }
+    Neighbourhood emptyNeighbors;
+
+    Neighbourhood neighbors = getNeighbours(pos);
+    for (std::pair<int, int> neighborPos : neighbors) {
+        ParticleType neighborType = grid.type(neighborPos.first, neighborPos.second);
+        if (rememberedParticleType == ParticleType::EMPTY && neighborType != ParticleType::CLONE && neighborType != ParticleType::EMPTY) {
+            rememberedParticleType = neighborType;
+        }
+        else if (neighborType == ParticleType::EMPTY) {
+            emptyNeighbors.push_back(neighborPos);
+        }
+    }
+
+    if (rememberedParticleType != ParticleType::EMPTY && !emptyNeighbors.empty()) {
+        // Randomly pick an empty neighbor to clone into
+        int randomIndex = SimRandom::index(int(emptyNeighbors.size()));
+        grid.set(emptyNeighbors[randomIndex].first, emptyNeighbors[randomIndex].second, Particle(rememberedParticleType));
+    }
+}
+
+// Conduction itself runs in SolveHeat, this only reacts to the temperature it left behind
+void checkPhaseTransitions(std::pair<int, int> pos) {
+    int x = pos.first;
+    int y = pos.second;
+
+    const generalParticleData* data = &getMaterial(grid.type(x, y));
+    if (data->lowerTransitionPoint != -1) {
+        if (grid.temperature(x, y) < data->lowerTransitionPoint * grid.transitionJitter(x, y)) {
+            transferParticleData(pos, Particle(data->lowerTransitionType));
+            PROFILE_COUNT(PHASE_TRANSITIONS);
+            data = &getMaterial(grid.type(x, y));
+        }
+    }
+
+    if (data->upperTransitionPoint != 9999999.9) {
+        if (grid.temperature(x, y) > data->upperTransitionPoint * grid.transitionJitter(x, y)) {
+            transferParticleData(pos, Particle(data->upperTransitionType));
+            PROFILE_COUNT(PHASE_TRANSITIONS);
+        }
+    }
+}
+
+// Build the shared particle table from the loaded materials, must run before any particle is created
+void InitializeParticleTable() {
+    const MaterialSet& materials = getMaterialSet();
+    materialCount = int(materials.materials.size());
+    interactionMatrix.fill(AlchemicReaction());
+    maxDispersion = 0;
+    multiReactions.clear();
+    materialEmissions.clear();
+    for (int i = 0; i < materialCount; i++) {
+        const MaterialRecord& record = materials.materials[i];
+        generalParticleData data;
+
+        data.type = ParticleType(i);
+        data.name = record.name;
+        data.color = glm::vec4(record.color[0], record.color[1], record.color[2], record.color[3]);
+        data.density = record.density;
+        data.temperature = record.temperature;
+        data.thermalConductivity = record.thermalConductivity;
+        data.specificHeatCapacity = record.specificHeatCapacity;
+        data.lowerTransitionPoint = record.lowerTransitionPoint;
+        data.lowerTransitionType = ParticleType(record.lowerTransitionType);
+        data.upperTransitionPoint = record.upperTransitionPoint;
+        data.upperTransitionType = ParticleType(record.upperTransitionType);
+        data.endOfLifeType = ParticleType(record.endOfLifeType);
+        data.state = ParticleState(record.state);
+        data.dispersion = record.dispersion;
+        maxDispersion = std::max(maxDispersion, data.dispersion);
+
+        // Rates vary a little from run to run: the half-life, then the emissions, then the reactions
+        data.halflife = record.halflife != -1 ? getRoughly(record.halflife, MATERIAL_RATE_JITTER) : -1;
+        data.firstEmission = uint32_t(materialEmissions.size());
+        data.emissionCount = record.emissionCount;
+        for (uint32_t e = 0; e < record.emissionCount; e++) {
+            const EmissionRecord& emission = materials.emissions[record.firstEmission + e];
+            materialEmissions.push_back({ ParticleType(emission.type), getRoughly(emission.halflife, MATERIAL_RATE_JITTER) });
+        }
+
+        // A reaction with a single prerequisite goes in the matrix cell of that neighbour type
+        data.reactionCount = record.reactionCount;
+        data.firstMultiReaction = uint32_t(multiReactions.size());
+        for (uint32_t r = 0; r < record.reactionCount; r++) {
+            const ReactionRecord& source = materials.reactions[record.firstReaction + r];
+            AlchemicReaction reaction;
+            reaction.halflife = getRoughly(source.halflife, MATERIAL_RATE_JITTER);
+            reaction.resultTemp = source.resultTemperature;
+            reaction.prerequisiteMask = source.prerequisiteMask;
+            reaction.resultType = ParticleType(source.resultType);
+            reaction.order = uint8_t(r);
+
+            if ((source.prerequisiteMask & (source.prerequisiteMask - 1)) == 0) {
+                interactionMatrix[size_t(i) * MAX_MATERIALS + lowestBit(source.prerequisiteMask)] = reaction;
+                data.reactiveNeighbours |= source.prerequisiteMask;
+            }
+            else {
+                multiReactions.push_back(reaction);
+                data.multiReactionCount++;
+            }
+        }
+
+        if (record.moves) {
+            data.movementDirections = getMovementDirectionsFromDensity(data.state, float(data.density));
+        }
+
+        switch (data.type) {
+        case ParticleType::CLONE:
+            data.specialActions.push_back(&clone);
+            break;
+        default:
+            break;
+        }
+
+        // Particles that conduct heat can change state once SolveHeat has moved their temperature
+        if (data.thermalConductivity > 0 && data.specificHeatCapacity > 0) {
+            data.specialPostActions.push_back(&checkPhaseTransitions);
+        }
+
+        // add alchemy
+        if (data.reactionCount > 0) {
+            data.specialPostActions.push_back(&checkAlchemyReactions);
+        }
+
+        // add particle emissions
+        if (data.emissionCount > 0) {
+            data.specialPostActions.push_back(&attemptEmissions);
+        }
+
+        particleTable[i] = std::move(data);
+    }
+}
+
+void setWalls(ParticleType type) {
+    // Set top and bottom walls
+    for (int x = 0; x < grid.getWidth(); x++) {
+        grid.set(x, 0, Particle(type)); // Top wall
+        grid.set(x, grid.getHeight() - 1, Particle(type)); // Bottom wall
+    }
+
+    // Set left and right walls
+    for (int y = 0; y < grid.getHeight(); y++) {
+        grid.set(0, y, Particle(type)); // Left wall
+        grid.set(grid.getWidth() - 1, y, Particle(type)); // Right wall
+    }
+}
+
+void InitializeGrid() {
+    for (int y = 0; y < grid.getHeight(); y++) {
+        for (int x = 0; x < grid.getWidth(); x++) {
+            grid.set(x, y, Particle(ParticleType::EMPTY));
+        }
+    }
+}
+
+// Create a list of all positions in the grid
+std::vector<std::pair<int, int>> positions;
+
+static void seedChunkEngines();
+
+void InitializeSimulation() {
+    simulationTick = 0;
+
+    // Everything random in the simulation derives from the RandomDevice seed
+    SimRandom::reseed(uint64_t(RandomDevice::gen()));
+    seedChunkEngines();
+
+    InitializeParticleTable();
+    InitializeHeatSolver();
+    InitializeBlockRules();
+    InitializeGrid();
+
+    positions.clear();
+    positions.reserve(size_t(grid.getWidth()) * grid.getHeight());
+    grid.chunks.wakeAll();
+}
+
+void ResizeWorld(int width, int height) {
+    grid.resize(width, height);
+    seedChunkEngines();
+    InitializeHeatSolver();
+    InitializeBlockRules();
+
+    positions.clear();
+    positions.reserve(size_t(width) * height);
+    grid.chunks.wakeAll();
+}
+
+//void fluidJank() {
+//    // adds vertical fluid movement to allow leveling under barriers
+//    if (particle.data.state == ParticleState::FLUID) {
+//        std::vector<int> offsets = { -1, 0, 1 };
+//        std::shuffle(offsets.begin(), offsets.end(), RandomDevice::gen);
+//    
+//        int totalFluidNeighbours = 0;
+//        for (int offset_x : offsets) {
+//            if (isValidIndex(pos.first + offset_x, pos.second - 1)) {
+//                if (grid[pos.first + offset_x][pos.second - 1].data.type == particle.data.type) {
+//                    totalFluidNeighbours += 1;
+//                }
+//            }
+//        }
+//    
+//        if (totalFluidNeighbours == 3) {
+//            if (RNG<double>::getRange(0, 1) < 0.9) {
+//                for (int offset_x : offsets) {
+//                    if (isValidIndex(pos.first + offset_x, pos.second + 1)) {
+//                        if (grid[pos.first + offset_x][pos.second + 1].data.type == ParticleType::EMPTY) {
+//                            if (StepInDirection({ pos.first, pos.second }, firstPos, particle, { offset_x, 1 }, depth + 1, timesSwapped)) {
+//                                return true; // Exit after first successful move
+//                            }
+//                        }
+//                    }
+//                }
+//            }
+//        }
+//    }
+//}
+
+int maxDispersion = 0;
+
+// Density swaps less likely than this don't keep a chunk awake (e.g. water resting on water)
+const double SWAP_SLEEP_THRESHOLD = 0.01;
+
+// Nearest cell from from to to (inclusive, walking by dx of 1 or -1) whose bit is set in bitsOf(word) for the
+// occupancy word it falls in, or -1 if there is none. Skips a whole word of cells at a time.
+template<typename Bits>
+static int nearestSetCell(int from, int to, int dx, Bits bitsOf) {
+    const int bits = Grid::OCCUPANCY_BITS;
+    int low = std::min(from, to);
+    int high = std::max(from, to);
+    int firstWord = low / bits;
+    int lastWord = high / bits;
+    for (int i = 0; i <= lastWord - firstWord; i++) {
+        int word = dx > 0 ? firstWord + i : lastWord - i;
+        uint64_t set = bitsOf(word);
+        if (word == firstWord) {
+            set &= ~uint64_t(0) << (low % bits);
+        }
+        if (word == lastWord) {
+            set &= ~uint64_t(0) >> (bits - 1 - high % bits);
+        }
+        if (set != 0) {
+            return word * bits + (dx > 0 ? lowestBit(set) : highestBit(set));
+        }
+    }
+    return -1;
+}
+
+// A fluid stepping sideways scans the row it steps into for the nearest cell it can flow into, up to its
+// dispersion past the first cell. It flows through other fluids, the way pressure levels a body of water, and on
+// across empty cells until the first one it could drop from. Returns false if nothing in reach has room.
+// The empty run and the cell to drop from are found from the occupancy bits, only the stretch of fluid before the
+// run is read cell by cell.
+static bool spreadFluid(int x, int y, int dx, int dy, int dispersion) {
+    int rowY = y + dy;
+    int firstX = x + dx;
+    if (!isValidIndex(firstX, rowY)) {
+        return false;
+    }
+    int lastX = std::clamp(x + dx * (dispersion + 1), 0, grid.getWidth() - 1);
+
+    int emptyX = nearestSetCell(firstX, lastX, dx, [&](int word) { return ~grid.occupancy(rowY, word); });
+    int stretchEnd = emptyX >= 0 ? emptyX : lastX + dx;
+    for (int cellX = firstX; cellX != stretchEnd; cellX += dx) {
+        ParticleType type = grid.type(cellX, rowY);
+        if (type == ParticleType::ERASER) {
+            grid.set(x, y, Particle(ParticleType::EMPTY));
+            PROFILE_COUNT(ERASED);
+            return true;
+        }
+
+        // Only other fluids can be flowed through
+        const generalParticleData& data = getMaterial(type);
+        if (data.state != ParticleState::FLUID || data.movementDirections.empty()) {
+            return false;
+        }
+    }
+    if (emptyX < 0) {
+        return false;
+    }
+
+    // Flow to the end of the empty run, or to the first cell in it with nothing below
+    int occupiedX = nearestSetCell(emptyX, lastX, dx, [&](int word) { return grid.occupancy(rowY, word); });
+    int targetX = occupiedX >= 0 ? occupiedX - dx : lastX;
+    if (rowY > 0) {
+        int dropX = nearestSetCell(emptyX, targetX, dx, [&](int word) { return ~(grid.occupancy(rowY, word) | grid.occupancy(rowY - 1, word)); });
+        if (dropX >= 0) {
+            targetX = dropX;
+        }
+    }
+
+    grid.move(x, y, targetX, rowY);
+    PROFILE_COUNT(MOVES);
+    return true;
+}
+
+bool StepInDirection(std::pair<int, int> pos, std::pair<int, int> direction) {
+    int x = pos.first;
+    int y = pos.second;
+
+    int newX = x + direction.first;
+    int newY = y + direction.second;
+
+    // Check if the new position is within bounds
+    if (!isValidIndex(newX, newY)) {
+        return false;
+    }
+
+    const generalParticleData& self = getMaterial(grid.type(x, y));
+    if (self.state == ParticleState::FLUID && direction.first != 0 && spreadFluid(x, y, direction.first, direction.second, self.dispersion)) {
+        return true;
+    }
+
+    ParticleType newType = grid.type(newX, newY);
+    if (newType == ParticleType::EMPTY) {
+        grid.move(x, y, newX, newY); // Also clears the previous position
+        PROFILE_COUNT(MOVES);
+        return true;
+    }
+    else if (newType == ParticleType::ERASER) {
+        grid.set(x, y, Particle(ParticleType::EMPTY)); // Clear the previous position
+        PROFILE_COUNT(ERASED);
+        return true;
+    }
+    // If no movement was possible, try swapping based on density
+    else if (!getMaterial(newType).movementDirections.empty()) {
+        double currentDensity = grid.density(x, y);
+        double neighborDensity = grid.density(newX, newY);
+
+        // Ensure densities are not zero to avoid division by zero
+        if (currentDensity > 0.0f && neighborDensity > 0.0f && currentDensity != neighborDensity) {
+            // Determine the larger and smaller densities
+            double largerDensity = std::max(currentDensity, neighborDensity);
+            double smallerDensity = std::min(currentDensity, neighborDensity);
+
+            // Calculate the swap probability proportional to the density difference
+            double swapProbability = smallerDensity / largerDensity;
+
+            swapProbability = (currentDensity < 1.2 ? swapProbability : 1.0 - swapProbability);
+
+            bool densityDirectionCheck = (currentDensity < 1.2 ? (currentDensity == smallerDensity) : (currentDensity == largerDensity));
+            if (SimRandom::range(0.0, 1.0) < swapProbability && // Lower probability for closer densities
+                densityDirectionCheck) {
+                // Swap particles to new positions
+                grid.swap(x, y, newX, newY);
+                PROFILE_COUNT(DENSITY_SWAPS);
+                return true; // Exit after first successful swap
+            }
+
+            // The swap may still happen on a later tick, unless it is too unlikely to matter
+            if (densityDirectionCheck && swapProbability > SWAP_SLEEP_THRESHOLD) {
+                grid.chunks.markDirty(x, y);
+            }
+        }
+    }
+
+    return false;
+}
+
+bool velocityMovement = false;
+
+// Share of the landing speed a fluid carries on sideways, powders just stop
+const float FLUID_SPLASH = 0.5f;
+
+// Sideways speed kept from one tick to the next, and the speed below which it stops
+const float HORIZONTAL_FRICTION = 0.9f;
+const float MIN_HORIZONTAL_SPEED = 0.25f;
+
+bool IntegrateVelocity(std::pair<int, int> pos) {
+    int x = pos.first;
+    int y = pos.second;
+
+    ParticleState state = getMaterial(grid.type(x, y)).state;
+    if ((state != ParticleState::POWDER && state != ParticleState::FLUID) || getMaterial(grid.type(x, y)).movementDirections.empty()) {
+        return false;
+    }
+
+    glm::vec2 velocity = grid.velocity(x, y);
+    glm::vec2 remainder = grid.remainder(x, y);
+
+    // Falling starts at the cell per tick the usual rules move at, particles stacked on a falling one keep falling with it
+    bool falling = y > 0 && (grid.type(x, y - 1) == ParticleType::EMPTY || grid.type(x, y - 1) == ParticleType::ERASER
+        || grid.velocity(x, y - 1).y < 0.0f);
+    velocity.y = falling ? std::max(-float(MAX_CELLS_PER_TICK), std::min(velocity.y, -1.0f) - GRAVITY) : 0.0f;
+    if (!falling) {
+        remainder.y = 0.0f;
+    }
+    velocity.x *= HORIZONTAL_FRICTION;
+    if (std::abs(velocity.x) < MIN_HORIZONTAL_SPEED) {
+        velocity.x = 0.0f;
+    }
+
+    if (velocity.x == 0.0f && velocity.y == 0.0f) {
+        if (grid.velocity(x, y) != velocity || grid.remainder(x, y) != glm::vec2(0.0f)) {
+            grid.velocity(x, y) = velocity;
+            grid.remainder(x, y) = glm::vec2(0.0f);
+        }
+        return false;
+    }
+
+    // Whole cells to travel this tick, the rest is kept for the next
+    remainder += velocity;
+    int dx = int(remainder.x);
+    int dy = int(remainder.y);
+    remainder -= glm::vec2(float(dx), float(dy));
+
+    // Walk the Bresenham line towards the target and stop in front of the first cell that isn't empty
+    int endX = x;
+    int endY = y;
+    bool blockedX = false;
+    bool blockedY = false;
+    int stepX = dx < 0 ? -1 : 1;
+    int stepY = dy < 0 ? -1 : 1;
+    int distanceX = std::abs(dx);
+    int distanceY = std::abs(dy);
+    int error = distanceX - distanceY;
+    for (int cell = 0; cell < std::max(distanceX, distanceY); cell++) {
+        int nextX = endX;
+        int nextY = endY;
+        if (2 * error > -distanceY) {
+            error -= distanceY;
+            nextX += stepX;
+        }
+        if (2 * error < distanceX) {
+            error += distanceX;
+            nextY += stepY;
+        }
+
+        ParticleType nextType = isValidIndex(nextX, nextY) ? grid.type(nextX, nextY) : ParticleType::WALL;
+        if (nextType == ParticleType::ERASER) {
+            grid.set(x, y, Particle(ParticleType::EMPTY));
+            PROFILE_COUNT(ERASED);
+            return true;
+        }
+        if (nextType != ParticleType::EMPTY) {
+            blockedX = nextX != endX;
+            blockedY = nextY != endY;
+            break;
+        }
+        endX = nextX;
+        endY = nextY;
+    }
+
+    // Catching up with a falling particle only slows down to its speed. Fluids landing turn part of the fall into
+    // sideways speed, in the direction they were already going if any
+    int blockerX = endX + (blockedX ? stepX : 0);
+    int blockerY = endY + stepY;
+    float blockerSpeed = blockedY && isValidIndex(blockerX, blockerY) ? grid.velocity(blockerX, blockerY).y : 0.0f;
+    if (blockedY && blockerSpeed < 0.0f) {
+        velocity.y = std::max(velocity.y, blockerSpeed);
+        remainder.y = 0.0f;
+    }
+    else if (blockedY) {
+        if (state == ParticleState::FLUID) {
+            float direction = velocity.x != 0.0f ? (velocity.x < 0.0f ? -1.0f : 1.0f) : (SimRandom::range(0.0, 1.0) < 0.5 ? -1.0f : 1.0f);
+            velocity.x += direction * FLUID_SPLASH * -velocity.y;
+        }
+        velocity.y = 0.0f;
+        remainder = glm::vec2(0.0f);
+    }
+    if (blockedX) {
+        velocity.x = 0.0f;
+        remainder.x = 0.0f;
+    }
+    velocity = glm::clamp(velocity, -float(MAX_CELLS_PER_TICK), float(MAX_CELLS_PER_TICK));
+
+    if (endX != x || endY != y) {
+        grid.move(x, y, endX, endY);
+        PROFILE_COUNT(MOVES);
+    }
+    else if (blockedX || blockedY) {
+        // Nothing travelled, this tick belongs to the usual rules
+        grid.velocity(x, y) = velocity;
+        grid.remainder(x, y) = remainder;
+        return false;
+    }
+    else {
+        // Not a whole cell yet, keep the chunk awake until it is
+        grid.chunks.markDirty(x, y);
+    }
+    grid.velocity(endX, endY) = velocity;
+    grid.remainder(endX, endY) = remainder;
+    return true;
+}
+
+void MoveParticle(std::pair<int, int> pos) {
+    int x = pos.first;
+    int y = pos.second;
+
+    if (velocityMovement && IntegrateVelocity(pos)) {
+        return;
+    }
+
+    bool moved = false;
+    const auto& movementDirections = getMaterial(grid.type(x, y)).movementDirections; // Keep const reference
+    FixedVector<size_t, MAX_MOVE_DIRECTIONS> tierIndices;
+    for (size_t i = 0; i < movementDirections.size(); i++) {
+        tierIndices.push_back(i); // Initialize indices for random access
+    }
+
+    while (!moved && !tierIndices.empty()) {
+        // Calculate probabilities based on the weights of the remaining tiers
+        FixedVector<float, MAX_MOVE_DIRECTIONS> weights;
+        for (size_t index : tierIndices) {
+            weights.push_back(movementDirections[index].first);
+        }
+
+        // Sample a tier based on probabilities
+        int chosenTierIndex = sampleFromProbabilities(weights);
+        size_t actualTierIndex = tierIndices[chosenTierIndex];
+
+        // Randomly sample directions without shuffling
+        auto& directions = movementDirections[actualTierIndex].second;
+        FixedVector<size_t, MAX_MOVE_DIRECTIONS> directionIndices;
+        for (size_t i = 0; i < directions.size(); i++) {
+            directionIndices.push_back(i); // Indices for random access
+        }
+
+        // Randomly pick a direction index
+        SimRandom::shuffle(directionIndices.begin(), directionIndices.end());
+
+        for (size_t dirIndex : directionIndices) {
+            const auto& direction = directions[dirIndex];
+
+            moved = StepInDirection(pos, direction);
+            if (moved) {
+                break;
+            }
+        }
+
+        if (!moved) {
+            // Remove the chosen tier index if no movement occurred
+            tierIndices.erase(tierIndices.begin() + chosenTierIndex);
+        }
+    }
+}
+
+TickTimings lastTickTimings;
+
+uint32_t simulationTick = 0;
+
+// Turn every particle whose lifetime ran out this tick into its endOfLifeType
+// Only the cells in the expiry lists for this tick are visited, so sleeping chunks still decay on time
+static void expireParticles() {
+    auto dueTick = [](int x, int y) { return grid.expiryTick(x, y); };
+    grid.chunks.expireDue(dueTick, [](int x, int y) {
+        uint32_t expiry = grid.expiryTick(x, y);
+        if (expiry == NO_EXPIRY) {
+            return;
+        }
+
+        if (expiry <= simulationTick) {
+            transferParticleData({ x, y }, Particle(getMaterial(grid.type(x, y)).endOfLifeType));
+        }
+        else {
+            grid.chunks.scheduleExpiry(x, y, expiry);
+        }
+    });
+}
+
+static double millisecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Append every particle inside the dirty rect of chunk (cx, cy), empty cells have nothing to update
+static void collectDirtyCells(int cx, int cy, std::vector<std::pair<int, int>>& cells) {
+    const DirtyRect& rect = grid.chunks.getDirtyRect(cx, cy);
+    const int bits = Grid::OCCUPANCY_BITS;
+    for (int y = rect.minY; y <= rect.maxY; y++) {
+        for (int word = rect.minX / bits; word <= rect.maxX / bits; word++) {
+            // Only the bits of the word inside [minX, maxX]
+            int first = std::max(rect.minX - word * bits, 0);
+            int last = std::min(rect.maxX - word * bits, bits - 1);
+            uint64_t occupied = grid.occupancy(y, word) & (~uint64_t(0) << first) & (~uint64_t(0) >> (bits - 1 - last));
+            while (occupied != 0) {
+                cells.emplace_back(word * bits + lowestBit(occupied), y);
+                occupied &= occupied - 1;
+            }
+        }
+    }
+}
+
+// At the start of each frame, perform all pre-frame special actions
+static void runPreActions(const std::vector<std::pair<int, int>>& cells) {
+    for (const auto& pos : cells) {
+        performSpecialActions(getMaterial(grid.type(pos.first, pos.second)).specialPreActions, pos);
+    }
+}
+
+// During each frame, perform all normal special actions
+static void runMovement(const std::vector<std::pair<int, int>>& cells) {
+    for (const auto& pos : cells) {
+        int x = pos.first;
+        int y = pos.second;
+
+        if (grid.type(x, y) != ParticleType::EMPTY) { // Check only non-empty particles
+            MoveParticle(pos);
+        }
+
+        performSpecialActions(getMaterial(grid.type(x, y)).specialActions, pos);
+    }
+}
+
+// At the end of each frame, perform all post-frame special actions
+static void runPostActions(const std::vector<std::pair<int, int>>& cells) {
+    for (const auto& pos : cells) {
+        performSpecialActions(getMaterial(grid.type(pos.first, pos.second)).specialPostActions, pos);
+    }
+}
+
+int maxUpdateReach() {
+    // Fluids scan sideways up to their dispersion past their first step, moving by velocity covers at most MAX_CELLS_PER_TICK
+    return std::max(maxDispersion + 1, MAX_CELLS_PER_TICK);
+}
+
+NeighborhoodType movementNeighbourhood = NeighborhoodType::Moore;
+
+void SetMovementNeighbourhood(NeighborhoodType type) {
+    if (type != movementNeighbourhood) {
+        grid.chunks.wakeAll();
+    }
+    movementNeighbourhood = type;
+}
+
+int simulationThreads = 1;
+
+// Parallel update state, chunkPositions and chunkEngines have one entry per chunk
+static std::unique_ptr<WorkStealingPool> simulationPool;
+static std::vector<std::vector<std::pair<int, int>>> chunkPositions;
+static std::vector<SimRandom::Engine> chunkEngines;
+static std::vector<int> checkerboardPasses[4];
+
+void SetSimulationThreads(int threadCount) {
+    simulationThreads = std::max(1, threadCount);
+
+    simulationPool.reset();
+    if (simulationThreads > 1) {
+        // Workers set up their scratch arenas right away rather than on their first task mid-tick
+        simulationPool = std::make_unique<WorkStealingPool>(simulationThreads - 1, [] {
+            ScratchArena::local();
+            PROFILE_THREAD("worker");
+        });
+    }
+}
+
+static void seedChunkEngines() {
+    size_t chunkCount = size_t(grid.chunks.getChunksX()) * grid.chunks.getChunksY();
+    chunkPositions.assign(chunkCount, {});
+    for (std::vector<std::pair<int, int>>& cells : chunkPositions) {
+        cells.reserve(size_t(CHUNK_SIZE) * CHUNK_SIZE); // A dirty rect never holds more than its chunk
+    }
+    chunkEngines.resize(chunkCount);
+    SimRandom::splitStreams(chunkEngines);
+}
+
+std::vector<SimRandom::Engine>& getChunkEngines() {
+    return chunkEngines;
+}
+
+// Chunks are split into four checkerboard passes by the parity of their chunk coordinates. Two chunks in the
+// same pass always have a whole chunk between them, and since no particle update reaches further than
+// maxUpdateReach cells, chunks in one pass can never touch the same cells and run without locking the grid.
+// Each phase runs its four passes back to back so all chunks finish a phase before the next one starts.
+static void UpdateParticlesParallel() {
+    auto phaseStart = std::chrono::steady_clock::now();
+
+    grid.chunks.beginTick();
+
+    // The calling thread can go several ticks without a chunk of its own, make sure its arena exists up front
+    ScratchArena::local();
+
+    int updatedCells = 0;
+    for (std::vector<int>& pass : checkerboardPasses) {
+        pass.clear();
+    }
+    for (int cy = 0; cy < grid.chunks.getChunksY(); cy++) {
+        for (int cx = 0; cx < grid.chunks.getChunksX(); cx++) {
+            int chunk = cy * grid.chunks.getChunksX() + cx;
+            chunkPositions[chunk].clear();
+            if (!grid.chunks.isAwake(cx, cy)) {
+                continue;
+            }
+
+            collectDirtyCells(cx, cy, chunkPositions[chunk]);
+            updatedCells += int(chunkPositions[chunk].size());
+            checkerboardPasses[(cy % 2) * 2 + (cx % 2)].push_back(chunk);
+        }
+    }
+    lastTickTimings.updatedCells = updatedCells;
+
+    {
+        PROFILE_SCOPE(HEAT);
+        SolveHeat(simulationPool.get());
+    }
+    lastTickTimings.heat = millisecondsSince(phaseStart);
+    phaseStart = std::chrono::steady_clock::now();
+
+    auto runPhase = [](void (*phase)(const std::vector<std::pair<int, int>>&), bool shuffleFirst) {
+        for (const std::vector<int>& pass : checkerboardPasses) {
+            simulationPool->parallelFor(int(pass.size()), [&](int i) {
+                int chunk = pass[i];
+
+                // Each chunk draws from its own engine so results don't depend on which thread runs it
+                SimRandom::setEngine(&chunkEngines[chunk]);
+                ScratchArena::Frame frame;
+                if (shuffleFirst) {
+                    SimRandom::shuffle(chunkPositions[chunk].begin(), chunkPositions[chunk].end());
+                }
+                phase(chunkPositions[chunk]);
+                SimRandom::setEngine(nullptr);
+            });
+        }
+    };
+
+    grid.setConcurrentWrites(true);
+
+    {
+        PROFILE_SCOPE(PRE_ACTIONS);
+        runPhase(runPreActions, true);
+    }
+    lastTickTimings.preActions = millisecondsSince(phaseStart);
+    phaseStart = std::chrono::steady_clock::now();
+
+    {
+        PROFILE_SCOPE(MOVEMENT);
+        runPhase(runMovement, false);
+    }
+    lastTickTimings.movement = millisecondsSince(phaseStart);
+    phaseStart = std::chrono::steady_clock::now();
+
+    {
+        PROFILE_SCOPE(POST_ACTIONS);
+        runPhase(runPostActions, false);
+        grid.setConcurrentWrites(false);
+        expireParticles();
+    }
+    lastTickTimings.postActions = millisecondsSince(phaseStart);
+
+    simulationTick++;
+    PROFILE_END_TICK(simulationTick);
+}
+
+// The Margolus engine only conducts heat, rewrites the blocks and expires particles, there are no special actions
+// Block updates never overlap, so unlike the chunk passes above they run on the pool whatever maxUpdateReach is.
+static void UpdateParticlesMargolus() {
+    auto phaseStart = std::chrono::steady_clock::now();
+
+    grid.chunks.beginTick();
+
+    {
+        PROFILE_SCOPE(HEAT);
+        SolveHeat(simulationPool.get());
+    }
+    lastTickTimings.heat = millisecondsSince(phaseStart);
+    lastTickTimings.preActions = 0.0;
+    phaseStart = std::chrono::steady_clock::now();
+
+    {
+        PROFILE_SCOPE(MOVEMENT);
+        lastTickTimings.updatedCells = UpdateBlocks(simulationPool.get());
+    }
+    lastTickTimings.movement = millisecondsSince(phaseStart);
+    phaseStart = std::chrono::steady_clock::now();
+
+    {
+        PROFILE_SCOPE(POST_ACTIONS);
+        expireParticles();
+    }
+    lastTickTimings.postActions = millisecondsSince(phaseStart);
+
+    simulationTick++;
+    PROFILE_END_TICK(simulationTick);
+}
+
+void UpdateParticles() {
+    if (movementNeighbourhood == NeighborhoodType::Margolus) {
+        UpdateParticlesMargolus();
+        return;
+    }
+
+    // Chunks in the same checkerboard pass must be further apart than two particle reaches
+    if (simulationPool && 2 * maxUpdateReach() < CHUNK_SIZE) {
+        UpdateParticlesParallel();
+        return;
+    }
+
+    auto phaseStart = std::chrono::steady_clock::now();
+
+    // Only cells inside the dirty rects of awake chunks get updated, sleeping chunks are skipped entirely
+    grid.chunks.beginTick();
+    positions.clear();
+    for (int cy = 0; cy < grid.chunks.getChunksY(); cy++) {
+        for (int cx = 0; cx < grid.chunks.getChunksX(); cx++) {
+            if (grid.chunks.isAwake(cx, cy)) {
+                collectDirtyCells(cx, cy, positions);
+            }
+        }
+    }
+    lastTickTimings.updatedCells = int(positions.size());
+
+    {
+        PROFILE_SCOPE(HEAT);
+        SolveHeat();
+    }
+    lastTickTimings.heat = millisecondsSince(phaseStart);
+    phaseStart = std::chrono::steady_clock::now();
+
+    {
+        PROFILE_SCOPE(PRE_ACTIONS);
+
+        // Shuffle the list of positions to randomize the update order
+        SimRandom::shuffle(positions.begin(), positions.end());
+
+        runPreActions(positions);
+    }
+    lastTickTimings.preActions = millisecondsSince(phaseStart);
+    phaseStart = std::chrono::steady_clock::now();
+
+    {
+        PROFILE_SCOPE(MOVEMENT);
+        runMovement(positions);
+    }
+    lastTickTimings.movement = millisecondsSince(phaseStart);
+    phaseStart = std::chrono::steady_clock::now();
+
+    {
+        PROFILE_SCOPE(POST_ACTIONS);
+        runPostActions(positions);
+        expireParticles();
+    }
+    lastTickTimings.postActions = millisecondsSince(phaseStart);
+
+    simulationTick++;
+    PROFILE_END_TICK(simulationTick);
+}
@@ -1,2 +1,945 @@
+#pragma once
+
 #include "MyEngine.h"
+#include "FixedVector.h"
+#include "SimRandom.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Grid size the game starts with, the grid itself is sized at runtime (see ResizeWorld)
+// The game keeps this size unless a snapshot of another size is loaded, only Headless takes a size or pages a world.
+const int DEFAULT_GRID_WIDTH = 60 * 4;
+const int DEFAULT_GRID_HEIGHT = 40 * 4;
+
+// Largest grid side accepted from files and the command line, bigger worlds are paged (see WorldPager.h)
+const int MAX_GRID_SIDE = 1 << 14;
+
+const int CELL_SIZE = 4; // Each grid cell will be 4x4 pixels
+
+const float CELSIUS_TO_KELVIN = 273.15f;
+
+// Materials the code refers to by name, defined in resources/materials.txt (see Materials.h)
+// The file lists these first and in this order, any materials it adds after them take the ids from COUNT on.
+enum class ParticleType : uint8_t {
+    EMPTY,
+    SAND,
+    WATER,
+    METHANE,
+    FIRE,
+    SMOKE,
+    STEAM,
+    STONE,
+    DUST,
+    LAVA,
+    CLONE,
+    ICE,
+    PLASMA,
+    WALL,
+    DIAMOND,
+    MERCURY,
+    OIL,
+    ERASER,
+    WOOD,
+    BURNING_WOOD,
+    COUNT // Number of built-in materials, materialCount has them all
+};
+
+// Most materials the materials file can define, the neighbour masks need one bit per type plus a stale bit
+const int MAX_MATERIALS = 31;
+static_assert(int(ParticleType::COUNT) <= MAX_MATERIALS, "The built-in materials have to fit the neighbour masks");
+
+inline uint32_t typeBit(ParticleType type) {
+    return 1u << uint32_t(type);
+}
+
+// Index of the lowest set bit, bits must not be 0
+inline int lowestBit(uint32_t bits) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, bits);
+    return int(index);
+#else
+    return __builtin_ctz(bits);
+#endif
+}
+
+inline int lowestBit(uint64_t bits) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, bits);
+    return int(index);
+#else
+    return __builtin_ctzll(bits);
+#endif
+}
+
+// Index of the highest set bit, bits must not be 0
+inline int highestBit(uint64_t bits) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse64(&index, bits);
+    return int(index);
+#else
+    return 63 - __builtin_clzll(bits);
+#endif
+}
+
+inline int countBits(uint64_t bits) {
+#ifdef _MSC_VER
+    return int(__popcnt64(bits));
+#else
+    return __builtin_popcountll(bits);
+#endif
+}
+
+enum class ParticleState {
+    EMPTY,
+    SOLID,
+    POWDER,
+    FLUID,
+    GAS,
+    PLASMA,
+};
+
+// A material turning into resultType when every prerequisite type is next to it
+// Reactions with one prerequisite live in interactionMatrix, the rest in multiReactions.
+struct AlchemicReaction {
+    double halflife = 0.0; // chance per frame between 0-1 for reaction to occur, 0 where there is no reaction
+    double resultTemp = -1; // the result is at least this hot, -1 keeps the temperature
+    uint32_t prerequisiteMask = 0; // typeBit of every prerequisite
+    ParticleType resultType = ParticleType::EMPTY;
+    uint8_t order = 0; // Position among the material's reactions, of those that pass their roll the first one happens
+};
+
+struct Emission {
+    ParticleType type;
+    double halflife; // chance per frame between 0-1 for emission to occur
+};
+
+// Special actions are free functions that act on the cell at the given position
+using SpecialAction = void (*)(std::pair<int, int>);
+
+// Immutable data shared by every particle of one type, built once at startup (see InitializeParticleTable)
+struct generalParticleData {
+    ParticleType type;
+
+    std::string name;
+    glm::vec4 color;
+
+    double density; // Kg/m^3
+
+    double temperature; // degrees K, the temperature a new particle spawns with
+    double thermalConductivity; // W/m*K
+    double specificHeatCapacity; // kJ/Kg*K
+
+    double lowerTransitionPoint;
+    ParticleType lowerTransitionType;
+
+    double upperTransitionPoint;
+    ParticleType upperTransitionType;
+
+    double halflife; // in updates/frames
+    ParticleType endOfLifeType;
+
+    ParticleState state;
+    int dispersion; // Fluids look this many cells past their first step along a row when spreading (see StepInDirection)
+
+    uint32_t reactionCount = 0; // Reactions in interactionMatrix and multiReactions together
+    uint32_t reactiveNeighbours = 0; // typeBit of every neighbour type with a reaction in this material's row of interactionMatrix
+    uint32_t firstMultiReaction = 0; // Reactions needing more than one neighbour type, in multiReactions
+    uint32_t multiReactionCount = 0;
+
+    uint32_t firstEmission = 0; // Particles to emit, in materialEmissions
+    uint32_t emissionCount = 0;
+
+    std::vector<std::pair<float, std::vector<std::pair<int, int>>>> movementDirections; // Directions to check for movement
+
+    std::vector<SpecialAction> specialPreActions; // at the start of a frame before any particles have updated
+    std::vector<SpecialAction> specialActions; // any point in a frame after this particle has updated
+    std::vector<SpecialAction> specialPostActions; // at the end of a frame after all particles have updated
+};
+
+// One entry per material, the first materialCount are filled by InitializeParticleTable
+extern std::array<generalParticleData, size_t(MAX_MATERIALS)> particleTable;
+extern int materialCount;
+
+inline const generalParticleData& getMaterial(ParticleType type) {
+    return particleTable[size_t(type)];
+}
+
+// Reactions with a single prerequisite, [self * MAX_MATERIALS + neighbour], filled by InitializeParticleTable
+extern std::array<AlchemicReaction, size_t(MAX_MATERIALS) * MAX_MATERIALS> interactionMatrix;
+
+// Reactions needing several neighbour types, each material's a contiguous run
+extern std::vector<AlchemicReaction> multiReactions;
+
+// Emissions of every material, each material's a contiguous run
+extern std::vector<Emission> materialEmissions;
+
+inline const AlchemicReaction& getInteraction(ParticleType self, ParticleType neighbour) {
+    return interactionMatrix[size_t(self) * MAX_MATERIALS + size_t(neighbour)];
+}
+
+// Reaction order of a material, in either table
+AlchemicReaction& getReaction(ParticleType type, uint32_t order);
+
+// Colors are stored packed as RGBA8, red in the lowest byte
+inline uint32_t packColor(const glm::vec4& color) {
+    uint32_t r = uint32_t(std::clamp(color.x, 0.0f, 1.0f) * 255.0f + 0.5f);
+    uint32_t g = uint32_t(std::clamp(color.y, 0.0f, 1.0f) * 255.0f + 0.5f);
+    uint32_t b = uint32_t(std::clamp(color.z, 0.0f, 1.0f) * 255.0f + 0.5f);
+    uint32_t a = uint32_t(std::clamp(color.w, 0.0f, 1.0f) * 255.0f + 0.5f);
+    return r | (g << 8) | (b << 16) | (a << 24);
+}
+
+inline glm::vec4 unpackColor(uint32_t color) {
+    return glm::vec4((color & 0xFF) / 255.0f, ((color >> 8) & 0xFF) / 255.0f, ((color >> 16) & 0xFF) / 255.0f, (color >> 24) / 255.0f);
+}
+
+// Per-cell flag bits
+enum CellFlags : uint8_t {
+    CELL_CONDUCTS_HEAT = 1 << 0, // Takes part in heat transfer
+};
+
+// Ticks completed since InitializeSimulation
+extern uint32_t simulationTick;
+
+// expiryTick of particles that never decay
+const uint32_t NO_EXPIRY = UINT32_MAX;
+
+// Tick on which a particle created now decays, for a chance of halflife per tick
+// Rolling that chance every tick gives a geometric lifetime, so the lifetime is drawn once up front instead
+inline uint32_t sampleExpiryTick(double halflife) {
+    if (halflife <= 0.0) {
+        return NO_EXPIRY;
+    }
+    if (halflife >= 1.0) {
+        return simulationTick;
+    }
+
+    double extraTicks = std::floor(std::log(1.0 - SimRandom::unit<double>()) / std::log(1.0 - halflife));
+    return simulationTick + uint32_t(std::min(extraTicks, double(NO_EXPIRY - 1 - simulationTick)));
+}
+
+// Define a structure for particles, only per-instance state lives here
+// This is the value form of a cell, the grid itself stores every field in its own plane
+struct Particle {
+    ParticleType type = ParticleType::EMPTY;
+    ParticleType rememberedParticleType = ParticleType::EMPTY; // Used by CLONE
+    uint8_t flags = 0;
+
+    uint32_t color = 0; // Material color with a little per-particle variation
+    float density = 0.0f; // Kg/m^3, slightly varied per particle
+    float transitionJitter = 1.0f; // Scales the material transition points for this particle
+    uint32_t expiryTick = NO_EXPIRY; // Tick this particle turns into its endOfLifeType
+
+    double temperature = 0.0; // degrees K
+
+    // Only used with velocity movement (see IntegrateVelocity), cells per tick with y pointing up
+    glm::vec2 velocity = glm::vec2(0.0f);
+    glm::vec2 remainder = glm::vec2(0.0f); // Accumulated velocity remainder, the part of a cell not travelled yet
+
+    Particle(ParticleType t = ParticleType::EMPTY) {
+        const generalParticleData& data = getMaterial(t);
+
+        type = t;
+        temperature = data.temperature;
+
+        if (t == ParticleType::EMPTY) {
+            return; // Empty cells are never drawn and never move, so skip the jitter
+        }
+
+        color = packColor(glm::mix(data.color, BLACK, float(SimRandom::roughly(0.1, 1.0))));
+        density = float(SimRandom::roughly(data.density, 0.0001));
+
+        if (data.thermalConductivity > 0 && data.specificHeatCapacity > 0) {
+            flags |= CELL_CONDUCTS_HEAT;
+            transitionJitter = float(SimRandom::roughly(1.0, 0.01));
+        }
+
+        if (data.halflife != -1) {
+            expiryTick = sampleExpiryTick(data.halflife);
+        }
+    }
+};
+
+// Chunks are square tiles of the grid used to skip settled regions
+const int CHUNK_SIZE = 32;
+
+// Inclusive cell rectangle, empty when min > max
+struct DirtyRect {
+    int minX = 1, minY = 1;
+    int maxX = 0, maxY = 0;
+
+    bool empty() const { return minX > maxX || minY > maxY; }
+
+    void expand(int x0, int y0, int x1, int y1) {
+        if (empty()) {
+            minX = x0; minY = y0; maxX = x1; maxY = y1;
+            return;
+        }
+        minX = std::min(minX, x0);
+        minY = std::min(minY, y0);
+        maxX = std::max(maxX, x1);
+        maxY = std::max(maxY, y1);
+    }
+};
+
+// Tracks which parts of the grid need updating, Noita style
+// Every chunk has the dirty rect being updated this tick and one collecting changes for the next tick.
+// A chunk whose next rect stays empty for a whole tick goes to sleep until something nearby marks it dirty again.
+class ChunkMap {
+public:
+    ChunkMap(int width, int height)
+        : width(width), height(height),
+          chunksX((width + CHUNK_SIZE - 1) / CHUNK_SIZE), chunksY((height + CHUNK_SIZE - 1) / CHUNK_SIZE),
+          current(size_t(chunksX) * chunksY), next(size_t(chunksX) * chunksY),
+          expiryHeads(size_t(chunksX) * chunksY * EXPIRY_LISTS, NO_LINK),
+          expiryNext(size_t(chunksX) * chunksY * CHUNK_CELLS), expiryPrev(size_t(chunksX) * chunksY * CHUNK_CELLS),
+          expiryList(size_t(chunksX) * chunksY * CHUNK_CELLS, NOT_SCHEDULED), thermallyActive(size_t(chunksX) * chunksY, 1),
+          locks(new std::atomic<bool>[size_t(chunksX) * chunksY]) {
+        for (size_t i = 0; i < next.size(); i++) {
+            locks[i] = false;
+        }
+    }
+
+    // While chunks are updated in parallel two workers can mark the same chunk, so rect updates get locked
+    void setConcurrentWrites(bool concurrent) { concurrentWrites = concurrent; }
+
+    int getChunksX() const { return chunksX; }
+    int getChunksY() const { return chunksY; }
+
+    // A change at (x, y) can affect its Moore neighbours, so they get updated next tick as well
+    void markDirty(int x, int y) {
+        int x0 = std::max(x - 1, 0);
+        int y0 = std::max(y - 1, 0);
+        int x1 = std::min(x + 1, width - 1);
+        int y1 = std::min(y + 1, height - 1);
+
+        for (int cy = y0 / CHUNK_SIZE; cy <= y1 / CHUNK_SIZE; cy++) {
+            for (int cx = x0 / CHUNK_SIZE; cx <= x1 / CHUNK_SIZE; cx++) {
+                size_t chunk = size_t(cy) * chunksX + cx;
+                lock(chunk);
+                next[chunk].expand(
+                    std::max(x0, cx * CHUNK_SIZE), std::max(y0, cy * CHUNK_SIZE),
+                    std::min(x1, (cx + 1) * CHUNK_SIZE - 1), std::min(y1, (cy + 1) * CHUNK_SIZE - 1));
+                unlock(chunk);
+            }
+        }
+    }
+
+    void wakeAll() {
+        for (int cy = 0; cy < chunksY; cy++) {
+            for (int cx = 0; cx < chunksX; cx++) {
+                next[size_t(cy) * chunksX + cx].expand(cx * CHUNK_SIZE, cy * CHUNK_SIZE,
+                    std::min((cx + 1) * CHUNK_SIZE, width) - 1, std::min((cy + 1) * CHUNK_SIZE, height) - 1);
+            }
+        }
+        std::fill(thermallyActive.begin(), thermallyActive.end(), 1);
+    }
+
+    // Called once at the start of every tick, the rects collected last tick become the ones to update
+    void beginTick() {
+        std::swap(current, next);
+        std::fill(next.begin(), next.end(), DirtyRect());
+    }
+
+    bool isAwake(int cx, int cy) const { return !current[size_t(cy) * chunksX + cx].empty(); }
+    const DirtyRect& getDirtyRect(int cx, int cy) const { return current[size_t(cy) * chunksX + cx]; }
+
+    int countAwake() const {
+        int count = 0;
+        for (const DirtyRect& rect : current) {
+            count += !rect.empty();
+        }
+        return count;
+    }
+
+    // Every cell holding a particle with a lifetime sits in one list of its chunk, picked by the tick it expires on
+    // A wheel of EXPIRY_SLOTS lists covers the ticks just ahead, later ones wait in an overflow list that is sorted
+    // into the wheel each time it comes round, so a tick only visits the cells expiring on it. NO_EXPIRY takes the
+    // cell off its list.
+    void scheduleExpiry(int x, int y, uint32_t tick) {
+        size_t chunk = size_t(y / CHUNK_SIZE) * chunksX + x / CHUNK_SIZE;
+        uint16_t cell = uint16_t((y % CHUNK_SIZE) * CHUNK_SIZE + x % CHUNK_SIZE);
+        lock(chunk);
+        unlinkExpiry(chunk, cell);
+        if (tick != NO_EXPIRY) {
+            linkExpiry(chunk, cell, tick);
+        }
+        unlock(chunk);
+    }
+
+    // Take every cell off the lists, rebuildCaches schedules them again
+    void clearExpiries() {
+        std::fill(expiryHeads.begin(), expiryHeads.end(), NO_LINK);
+        std::fill(expiryList.begin(), expiryList.end(), NOT_SCHEDULED);
+    }
+
+    // Call expire(x, y) for every cell scheduled to expire on simulationTick, once per tick and never in parallel
+    // Entries can be stale when the planes were written directly (see rebuildCaches), so expire has to check the
+    // cell's own expiryTick. Cells scheduled while this runs for the tick it handles wait until the next one.
+    template<typename DueTick, typename Expire>
+    void expireDue(DueTick dueTick, Expire expire) {
+        if (simulationTick % EXPIRY_SLOTS == 0) {
+            sortOverflow(dueTick);
+        }
+
+        expiring = true;
+        int slot = int(simulationTick % EXPIRY_SLOTS);
+        for (int cy = 0; cy < chunksY; cy++) {
+            for (int cx = 0; cx < chunksX; cx++) {
+                size_t chunk = size_t(cy) * chunksX + cx;
+                uint16_t& head = expiryHeads[chunk * EXPIRY_LISTS + slot];
+                while (head != NO_LINK) {
+                    uint16_t cell = head;
+                    unlinkExpiry(chunk, cell);
+                    expire(cx * CHUNK_SIZE + cell % CHUNK_SIZE, cy * CHUNK_SIZE + cell / CHUNK_SIZE);
+                }
+            }
+        }
+        expiring = false;
+    }
+
+    // Chunks heat is still spreading through, SolveHeat conducts in these and the awake chunks only
+    bool isThermallyActive(int cx, int cy) const { return thermallyActive[size_t(cy) * chunksX + cx] != 0; }
+    void setThermallyActive(int cx, int cy, bool active) { thermallyActive[size_t(cy) * chunksX + cx] = active; }
+
+    // Rect collected so far for the next tick, snapshots store it so a loaded world resumes exactly
+    const DirtyRect& getPendingRect(int cx, int cy) const { return next[size_t(cy) * chunksX + cx]; }
+    void setPendingRect(int cx, int cy, const DirtyRect& rect) { next[size_t(cy) * chunksX + cx] = rect; }
+
+private:
+    static constexpr int CHUNK_CELLS = CHUNK_SIZE * CHUNK_SIZE;
+    static constexpr uint32_t EXPIRY_SLOTS = 64;
+    static constexpr int OVERFLOW_LIST = int(EXPIRY_SLOTS);
+    static constexpr int EXPIRY_LISTS = OVERFLOW_LIST + 1;
+    static constexpr uint16_t NO_LINK = UINT16_MAX;
+    static constexpr uint8_t NOT_SCHEDULED = UINT8_MAX;
+    static_assert(CHUNK_CELLS < NO_LINK, "Cells are linked by their index inside the chunk");
+
+    // A tick already being expired only takes cells due on later ticks
+    void linkExpiry(size_t chunk, uint16_t cell, uint32_t tick) {
+        uint32_t due = std::max(tick, simulationTick + (expiring ? 1 : 0));
+        int list = due - simulationTick < EXPIRY_SLOTS ? int(due % EXPIRY_SLOTS) : OVERFLOW_LIST;
+        size_t i = chunk * CHUNK_CELLS + cell;
+        uint16_t& head = expiryHeads[chunk * EXPIRY_LISTS + list];
+        expiryPrev[i] = NO_LINK;
+        expiryNext[i] = head;
+        if (head != NO_LINK) {
+            expiryPrev[chunk * CHUNK_CELLS + head] = cell;
+        }
+        head = cell;
+        expiryList[i] = uint8_t(list);
+    }
+
+    void unlinkExpiry(size_t chunk, uint16_t cell) {
+        size_t i = chunk * CHUNK_CELLS + cell;
+        if (expiryList[i] == NOT_SCHEDULED) {
+            return;
+        }
+        uint16_t prev = expiryPrev[i];
+        uint16_t next = expiryNext[i];
+        if (prev != NO_LINK) {
+            expiryNext[chunk * CHUNK_CELLS + prev] = next;
+        }
+        else {
+            expiryHeads[chunk * EXPIRY_LISTS + expiryList[i]] = next;
+        }
+        if (next != NO_LINK) {
+            expiryPrev[chunk * CHUNK_CELLS + next] = prev;
+        }
+        expiryList[i] = NOT_SCHEDULED;
+    }
+
+    // Move the overflow cells due within the next EXPIRY_SLOTS ticks into the wheel
+    // Runs as the wheel starts a new turn, every cell it leaves behind is due after the next one starts.
+    template<typename DueTick>
+    void sortOverflow(DueTick dueTick) {
+        for (int cy = 0; cy < chunksY; cy++) {
+            for (int cx = 0; cx < chunksX; cx++) {
+                size_t chunk = size_t(cy) * chunksX + cx;
+                uint16_t cell = expiryHeads[chunk * EXPIRY_LISTS + OVERFLOW_LIST];
+                expiryHeads[chunk * EXPIRY_LISTS + OVERFLOW_LIST] = NO_LINK;
+                while (cell != NO_LINK) {
+                    uint16_t next = expiryNext[chunk * CHUNK_CELLS + cell];
+                    expiryList[chunk * CHUNK_CELLS + cell] = NOT_SCHEDULED;
+                    uint32_t tick = dueTick(cx * CHUNK_SIZE + cell % CHUNK_SIZE, cy * CHUNK_SIZE + cell / CHUNK_SIZE);
+                    if (tick != NO_EXPIRY) {
+                        linkExpiry(chunk, cell, tick);
+                    }
+                    cell = next;
+                }
+            }
+        }
+    }
+
+    void lock(size_t chunk) {
+        if (concurrentWrites) {
+            while (locks[chunk].exchange(true, std::memory_order_acquire)) {}
+        }
+    }
+
+    void unlock(size_t chunk) {
+        if (concurrentWrites) {
+            locks[chunk].store(false, std::memory_order_release);
+        }
+    }
+
+    int width;
+    int height;
+    int chunksX;
+    int chunksY;
+
+    std::vector<DirtyRect> current;
+    std::vector<DirtyRect> next;
+    // Expiry lists, EXPIRY_LISTS heads per chunk and links per cell, each cell indexed inside its chunk
+    std::vector<uint16_t> expiryHeads;
+    std::vector<uint16_t> expiryNext;
+    std::vector<uint16_t> expiryPrev;
+    std::vector<uint8_t> expiryList; // Which list of its chunk the cell is on, NOT_SCHEDULED for none
+    bool expiring = false; // Inside expireDue
+    std::vector<uint8_t> thermallyActive;
+
+    std::unique_ptr<std::atomic<bool>[]> locks;
+    bool concurrentWrites = false;
+};
+
+// Structure-of-arrays particle storage
+// Every field of Particle lives in its own contiguous row-major plane, all planes share one allocation
+// Every write through set/move/swap marks the touched cells dirty in chunks
+class Grid {
+public:
+    Grid(int width, int height) : chunks(width, height) {
+        allocate(width, height);
+    }
+
+    ~Grid() {
+        ::operator delete(storage, std::align_val_t(PLANE_ALIGNMENT));
+    }
+
+    Grid(const Grid&) = delete;
+    Grid& operator=(const Grid&) = delete;
+
+    // Reallocate every plane for a new size, all cells empty and every chunk asleep
+    void resize(int newWidth, int newHeight) {
+        ::operator delete(storage, std::align_val_t(PLANE_ALIGNMENT));
+        storage = nullptr;
+        chunks = ChunkMap(newWidth, newHeight);
+        allocate(newWidth, newHeight);
+    }
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+
+    // While chunks are updated in parallel writes to shared rows and chunks have to be atomic, which costs
+    void setConcurrentWrites(bool concurrent) {
+        concurrentWrites = concurrent;
+        chunks.setConcurrentWrites(concurrent);
+    }
+
+    size_t index(int x, int y) const { return size_t(y) * size_t(width) + size_t(x); }
+
+    // Field accessors
+    ParticleType type(int x, int y) const { return types[index(x, y)]; }
+    uint32_t color(int x, int y) const { return colors[index(x, y)]; }
+    float density(int x, int y) const { return densities[index(x, y)]; }
+    float transitionJitter(int x, int y) const { return transitionJitters[index(x, y)]; }
+    uint8_t flags(int x, int y) const { return flagBits[index(x, y)]; }
+    uint32_t expiryTick(int x, int y) const { return expiryTicks[index(x, y)]; }
+    double& temperature(int x, int y) { return temperatures[index(x, y)]; }
+    ParticleType& rememberedType(int x, int y) { return rememberedTypes[index(x, y)]; }
+    glm::vec2& velocity(int x, int y) { return velocities[index(x, y)]; }
+    glm::vec2& remainder(int x, int y) { return remainders[index(x, y)]; }
+
+    // One bit per non-empty cell, every row a run of 64-bit words with x = 64 * word + bit
+    // Kept up to date by every write, so scans can skip empty cells a word at a time.
+    static constexpr int OCCUPANCY_BITS = 64;
+    int getOccupancyWords() const { return occupancyWords; }
+    uint64_t occupancy(int y, int word) const { return occupancyBits[size_t(y) * occupancyWords + word].load(std::memory_order_relaxed); }
+
+    int countRowParticles(int y) const {
+        int count = 0;
+        for (int word = 0; word < occupancyWords; word++) {
+            count += countBits(occupancy(y, word));
+        }
+        return count;
+    }
+
+    int countParticles() const {
+        int count = 0;
+        for (int y = 0; y < height; y++) {
+            count += countRowParticles(y);
+        }
+        return count;
+    }
+
+    // Raw planes for whole-grid scans
+    const ParticleType* typePlane() const { return types; }
+    const uint32_t* colorPlane() const { return colors; }
+    double* temperaturePlane() { return temperatures; }
+
+    // Every stored field of Particle as raw bytes, in a fixed order, for copying whole planes (see Snapshot.h)
+    struct RawPlane {
+        unsigned char* bytes;
+        size_t elementSize;
+    };
+    static constexpr size_t STORED_PLANE_COUNT = 10;
+
+    std::array<RawPlane, STORED_PLANE_COUNT> storedPlanes() {
+        return { {
+            { reinterpret_cast<unsigned char*>(types), sizeof(ParticleType) },
+            { reinterpret_cast<unsigned char*>(rememberedTypes), sizeof(ParticleType) },
+            { flagBits, sizeof(uint8_t) },
+            { reinterpret_cast<unsigned char*>(colors), sizeof(uint32_t) },
+            { reinterpret_cast<unsigned char*>(densities), sizeof(float) },
+            { reinterpret_cast<unsigned char*>(transitionJitters), sizeof(float) },
+            { reinterpret_cast<unsigned char*>(expiryTicks), sizeof(uint32_t) },
+            { reinterpret_cast<unsigned char*>(temperatures), sizeof(double) },
+            { reinterpret_cast<unsigned char*>(velocities), sizeof(glm::vec2) },
+            { reinterpret_cast<unsigned char*>(remainders), sizeof(glm::vec2) },
+        } };
+    }
+
+    // Rebuild what is derived from the planes (neighbour masks, occupancy, expiry schedule) after writing them directly
+    void rebuildCaches() {
+        for (size_t i = 0; i < size_t(width) * height; i++) {
+            neighbourMasks[i] = NEIGHBOUR_MASK_STALE;
+        }
+        for (int y = 0; y < height; y++) {
+            for (int word = 0; word < occupancyWords; word++) {
+                uint64_t bits = 0;
+                for (int x = word * OCCUPANCY_BITS; x < std::min(width, (word + 1) * OCCUPANCY_BITS); x++) {
+                    bits |= uint64_t(types[index(x, y)] != ParticleType::EMPTY) << (x % OCCUPANCY_BITS);
+                }
+                occupancyBits[size_t(y) * occupancyWords + word].store(bits, std::memory_order_relaxed);
+            }
+        }
+        for (int y = 0; y < height; y++) {
+            changedRows[y].store(true, std::memory_order_relaxed);
+        }
+
+        chunks.clearExpiries();
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                if (expiryTicks[index(x, y)] != NO_EXPIRY) {
+                    chunks.scheduleExpiry(x, y, expiryTicks[index(x, y)]);
+                }
+            }
+        }
+    }
+
+    // Push every lifetime in [x0, x1) x [y0, y1) back by ticks, for cells that sat out that many ticks
+    // Writes the plane directly, so rebuildCaches has to follow.
+    void delayExpiries(int x0, int y0, int x1, int y1, uint32_t ticks) {
+        for (int y = y0; y < y1; y++) {
+            for (int x = x0; x < x1; x++) {
+                uint32_t& expiry = expiryTicks[index(x, y)];
+                if (expiry != NO_EXPIRY) {
+                    expiry = uint32_t(std::min(uint64_t(expiry) + ticks, uint64_t(NO_EXPIRY - 1)));
+                }
+            }
+        }
+    }
+
+    // typeBit of every type among the Moore neighbours of (x, y)
+    // Masks are cached per cell and only rebuilt after a neighbour changed type
+    uint32_t neighbourTypes(int x, int y) {
+        uint32_t& mask = neighbourMasks[index(x, y)];
+        if (mask & NEIGHBOUR_MASK_STALE) {
+            mask = 0;
+            for (int ny = std::max(y - 1, 0); ny <= std::min(y + 1, height - 1); ny++) {
+                for (int nx = std::max(x - 1, 0); nx <= std::min(x + 1, width - 1); nx++) {
+                    if (nx != x || ny != y) {
+                        mask |= typeBit(types[index(nx, ny)]);
+                    }
+                }
+            }
+        }
+        return mask;
+    }
+
+    // Whether row y was written since the last call for it, lets renderers copy only the rows that changed
+    bool takeRowChanged(int y) { return changedRows[y].exchange(false, std::memory_order_relaxed); }
+
+    Particle get(int x, int y) const {
+        return read(index(x, y));
+    }
+
+    void set(int x, int y, const Particle& particle) {
+        writeAt(x, y, particle);
+        chunks.markDirty(x, y);
+    }
+
+    // Move a particle into another cell, leaving an empty cell behind
+    void move(int fromX, int fromY, int toX, int toY) {
+        writeAt(toX, toY, read(index(fromX, fromY)));
+        writeAt(fromX, fromY, Particle(ParticleType::EMPTY));
+        chunks.markDirty(fromX, fromY);
+        chunks.markDirty(toX, toY);
+    }
+
+    void swap(int x1, int y1, int x2, int y2) {
+        Particle particleA = read(index(x1, y1));
+        writeAt(x1, y1, read(index(x2, y2)));
+        writeAt(x2, y2, particleA);
+        chunks.markDirty(x1, y1);
+        chunks.markDirty(x2, y2);
+    }
+
+    ChunkMap chunks;
+
+private:
+    static constexpr size_t PLANE_ALIGNMENT = 64;
+    static constexpr uint32_t NEIGHBOUR_MASK_STALE = 1u << 31;
+
+    static size_t alignPlane(size_t bytes) {
+        return (bytes + PLANE_ALIGNMENT - 1) / PLANE_ALIGNMENT * PLANE_ALIGNMENT;
+    }
+
+    // Lay out and clear the planes for a width x height grid
+    void allocate(int newWidth, int newHeight) {
+        width = newWidth;
+        height = newHeight;
+        changedRows.reset(new std::atomic<bool>[size_t(height)]);
+        size_t cells = size_t(width) * size_t(height);
+
+        occupancyWords = (width + OCCUPANCY_BITS - 1) / OCCUPANCY_BITS;
+        occupancyBits.reset(new std::atomic<uint64_t>[size_t(height) * occupancyWords]);
+        for (size_t word = 0; word < size_t(height) * occupancyWords; word++) {
+            occupancyBits[word] = 0;
+        }
+
+        // Widest fields first so every plane stays naturally aligned
+        size_t bytes = 0;
+        size_t temperatureOffset = bytes; bytes += alignPlane(cells * sizeof(double));
+        size_t velocityOffset = bytes; bytes += alignPlane(cells * sizeof(glm::vec2));
+        size_t remainderOffset = bytes; bytes += alignPlane(cells * sizeof(glm::vec2));
+        size_t colorOffset = bytes; bytes += alignPlane(cells * sizeof(uint32_t));
+        size_t neighbourMaskOffset = bytes; bytes += alignPlane(cells * sizeof(uint32_t));
+        size_t expiryTickOffset = bytes; bytes += alignPlane(cells * sizeof(uint32_t));
+        size_t densityOffset = bytes; bytes += alignPlane(cells * sizeof(float));
+        size_t transitionJitterOffset = bytes; bytes += alignPlane(cells * sizeof(float));
+        size_t typeOffset = bytes; bytes += alignPlane(cells * sizeof(ParticleType));
+        size_t rememberedTypeOffset = bytes; bytes += alignPlane(cells * sizeof(ParticleType));
+        size_t flagsOffset = bytes; bytes += alignPlane(cells * sizeof(uint8_t));
+
+        storage = static_cast<unsigned char*>(::operator new(bytes, std::align_val_t(PLANE_ALIGNMENT)));
+
+        temperatures = reinterpret_cast<double*>(storage + temperatureOffset);
+        velocities = reinterpret_cast<glm::vec2*>(storage + velocityOffset);
+        remainders = reinterpret_cast<glm::vec2*>(storage + remainderOffset);
+        colors = reinterpret_cast<uint32_t*>(storage + colorOffset);
+        neighbourMasks = reinterpret_cast<uint32_t*>(storage + neighbourMaskOffset);
+        expiryTicks = reinterpret_cast<uint32_t*>(storage + expiryTickOffset);
+        densities = reinterpret_cast<float*>(storage + densityOffset);
+        transitionJitters = reinterpret_cast<float*>(storage + transitionJitterOffset);
+        types = reinterpret_cast<ParticleType*>(storage + typeOffset);
+        rememberedTypes = reinterpret_cast<ParticleType*>(storage + rememberedTypeOffset);
+        flagBits = storage + flagsOffset;
+
+        Particle empty;
+        for (size_t i = 0; i < cells; i++) {
+            write(i, empty);
+            neighbourMasks[i] = NEIGHBOUR_MASK_STALE;
+        }
+        for (int y = 0; y < height; y++) {
+            changedRows[y] = true;
+        }
+    }
+
+    Particle read(size_t i) const {
+        Particle particle;
+        particle.type = types[i];
+        particle.rememberedParticleType = rememberedTypes[i];
+        particle.flags = flagBits[i];
+        particle.color = colors[i];
+        particle.density = densities[i];
+        particle.transitionJitter = transitionJitters[i];
+        particle.expiryTick = expiryTicks[i];
+        particle.temperature = temperatures[i];
+        particle.velocity = velocities[i];
+        particle.remainder = remainders[i];
+        return particle;
+    }
+
+    // Write a particle and, if its type changed, mark the neighbour masks around it stale and update its occupancy bit
+    void writeAt(int x, int y, const Particle& particle) {
+        size_t i = index(x, y);
+        if (types[i] != particle.type) {
+            for (int ny = std::max(y - 1, 0); ny <= std::min(y + 1, height - 1); ny++) {
+                for (int nx = std::max(x - 1, 0); nx <= std::min(x + 1, width - 1); nx++) {
+                    neighbourMasks[index(nx, ny)] |= NEIGHBOUR_MASK_STALE;
+                }
+            }
+
+            bool occupied = particle.type != ParticleType::EMPTY;
+            if (occupied != (types[i] != ParticleType::EMPTY)) {
+                setOccupied(x, y, occupied);
+            }
+        }
+        // A cell leaves its expiry list when it's overwritten and joins the right one for the new particle
+        bool scheduled = expiryTicks[i] != NO_EXPIRY || particle.expiryTick != NO_EXPIRY;
+        write(i, particle);
+        changedRows[y].store(true, std::memory_order_relaxed);
+
+        if (scheduled) {
+            chunks.scheduleExpiry(x, y, particle.expiryTick);
+        }
+    }
+
+    void setOccupied(int x, int y, bool occupied) {
+        std::atomic<uint64_t>& word = occupancyBits[size_t(y) * occupancyWords + x / OCCUPANCY_BITS];
+        uint64_t bit = uint64_t(1) << (x % OCCUPANCY_BITS);
+        if (concurrentWrites) {
+            if (occupied) {
+                word.fetch_or(bit, std::memory_order_relaxed);
+            }
+            else {
+                word.fetch_and(~bit, std::memory_order_relaxed);
+            }
+            return;
+        }
+
+        // A plain read-modify-write when nothing else writes at the same time
+        uint64_t bits = word.load(std::memory_order_relaxed);
+        word.store(occupied ? bits | bit : bits & ~bit, std::memory_order_relaxed);
+    }
+
+    void write(size_t i, const Particle& particle) {
+        types[i] = particle.type;
+        rememberedTypes[i] = particle.rememberedParticleType;
+        flagBits[i] = particle.flags;
+        colors[i] = particle.color;
+        densities[i] = particle.density;
+        transitionJitters[i] = particle.transitionJitter;
+        expiryTicks[i] = particle.expiryTick;
+        temperatures[i] = particle.temperature;
+        velocities[i] = particle.velocity;
+        remainders[i] = particle.remainder;
+    }
+
+    int width;
+    int height;
+
+    unsigned char* storage = nullptr;
+
+    double* temperatures = nullptr;
+    glm::vec2* velocities = nullptr;
+    glm::vec2* remainders = nullptr;
+    uint32_t* colors = nullptr;
+    uint32_t* neighbourMasks = nullptr;
+    uint32_t* expiryTicks = nullptr;
+    float* densities = nullptr;
+    float* transitionJitters = nullptr;
+    ParticleType* types = nullptr;
+    ParticleType* rememberedTypes = nullptr;
+    uint8_t* flagBits = nullptr;
+
+    // Set by every write, chunks updating in parallel can share rows so the flags are atomic
+    std::unique_ptr<std::atomic<bool>[]> changedRows;
+
+    // Chunks updating in parallel write into each other's words as well, so then bits are set and cleared atomically
+    int occupancyWords = 0;
+    std::unique_ptr<std::atomic<uint64_t>[]> occupancyBits;
+    bool concurrentWrites = false;
+};
+
+// The grid holding every particle
+extern Grid grid;
+
+inline bool isValidIndex(int x, int y) {
+    return (x >= 0 && x < grid.getWidth() && y >= 0 && y < grid.getHeight());
+}
+
+// Define an enum for neighborhood types
+enum class NeighborhoodType {
+    Moore,
+    Margolus
+};
+
+// Neighbour positions kept on the stack, a Moore neighbourhood has at most 8 cells
+using Neighbourhood = FixedVector<std::pair<int, int>, 8>;
+
+Neighbourhood getMooreNeighbours(std::pair<int, int> pos);
+Neighbourhood getMargolusNeighbours(std::pair<int, int> pos);
+Neighbourhood getNeighbours(std::pair<int, int> pos, NeighborhoodType type = NeighborhoodType::Moore);
+
+void transferParticleData(std::pair<int, int> pos, Particle newParticle, bool copySourceTemp = true);
+void performSpecialActions(const std::vector<SpecialAction>& _specialActions, std::pair<int, int> pos);
+
+// Special actions
+void checkAlchemyReactions(std::pair<int, int> pos);
+void attemptEmissions(std::pair<int, int> pos);
+void clone(std::pair<int, int> pos);
+void checkPhaseTransitions(std::pair<int, int> pos);
+
+void InitializeParticleTable();
+void setWalls(ParticleType type);
+void InitializeGrid();
+
+// Builds the particle table, clears the grid and sets up the update order
+// Seed RandomDevice and load the materials (LoadMaterials in Materials.h) before calling.
+// The grid keeps whatever size it has, DEFAULT_GRID_WIDTH x DEFAULT_GRID_HEIGHT unless ResizeWorld changed it
+void InitializeSimulation();
+
+// Give the grid a new size, leaving it empty, and resize everything that follows the grid along with it
+void ResizeWorld(int width, int height);
+
+// Largest dispersion in the particle table, set by InitializeParticleTable
+extern int maxDispersion;
+
+// How UpdateParticles moves particles, Moore by default
+// Moore updates every particle in random order with the full rule set, Margolus rewrites 2x2 blocks from a
+// lookup table instead (see Margolus.h), which is much faster but leaves out most of the rules.
+extern NeighborhoodType movementNeighbourhood;
+
+// Switch engines, waking every chunk since what settled under one engine may not be settled under the other
+void SetMovementNeighbourhood(NeighborhoodType type);
+
+// Velocity movement, off by default: powders and fluids falling through empty space speed up under gravity
+// and cover several cells per tick along a line, instead of probing one neighbour per tick. Where they land
+// fluids carry some of the fall on sideways, and once at rest everything moves by the usual rules again.
+extern bool velocityMovement;
+
+const float GRAVITY = 0.25f; // Cells per tick, per tick
+const int MAX_CELLS_PER_TICK = 8; // Speed limit along either axis, has to stay within maxUpdateReach
+
+// Move the particle at pos by its velocity, returns false if it is at rest and should move by the usual rules
+bool IntegrateVelocity(std::pair<int, int> pos);
+
+// Furthest from its own cell that a single particle update can read or write
+int maxUpdateReach();
+bool StepInDirection(std::pair<int, int> pos, std::pair<int, int> direction);
+void MoveParticle(std::pair<int, int> pos);
+
+// Wall clock time spent in each phase of the last UpdateParticles call, in milliseconds
+struct TickTimings {
+    double heat = 0.0;
+    double preActions = 0.0;
+    double movement = 0.0;
+    double postActions = 0.0;
+
+    int updatedCells = 0; // Particles inside awake chunk rects (or the blocks visited, for Margolus), empty cells are skipped
+
+    double total() const { return heat + preActions + movement + postActions; }
+};
+
+extern TickTimings lastTickTimings;
+
+// Threads used by UpdateParticles, 1 runs the plain serial update
+// With more, chunks are updated in parallel in checkerboard passes on a work-stealing pool
+extern int simulationThreads;
+void SetSimulationThreads(int threadCount);
+
+// Engines the parallel update draws from, one per chunk
+std::vector<SimRandom::Engine>& getChunkEngines();
 
+void UpdateParticles();
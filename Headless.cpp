@@ -0,0 +1,741 @@
+#include "FrameExporter.h"
+#include "Framebuffer.h"
+#include "Game.h"
+#include "HeatSolver.h"
+#include "InputLog.h"
+#include "Materials.h"
+#include "Profiler.h"
+#include "Scenarios.h"
+#include "Snapshot.h"
+#include "WorldPager.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <iomanip>
+#include <new>
+#include <thread>
+
+// Headless runner: steps the simulation with no window or GL context and reports throughput
+// Usage: Headless [--scenario name] [--ticks N] [--warmup N] [--seed N] [--threads N] [--scaling] [--check-allocations] [--check-heat] [--check-paging]
+//        [--load path] [--save path] [--replay path] [--render] [--dump-frame path]
+//        [--export path] [--export-every N] [--export-format png|raw] [--export-buffers N] [--size WxH]
+//        [--world WxH] [--page-file path] [--pan N] [--materials path] [--profile path] [--trace path] [--velocity] [--margolus] [--list]
+
+// Every global operator new and delete is replaced here so --check-allocations can count heap use during ticks
+// That includes the array, nothrow and over-aligned forms, otherwise some allocations would slip past the count.
+static std::atomic<size_t> allocationCount{ 0 };
+
+// Count an allocation, returns nullptr when out of memory so the throwing and nothrow forms can share it
+static void* countedAllocate(size_t size) noexcept {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+static void* countedAllocate(size_t size, std::align_val_t alignment) noexcept {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+
+    // aligned_alloc wants the size to be a multiple of the alignment
+    size_t align = size_t(alignment);
+    size = size == 0 ? align : (size + align - 1) / align * align;
+#ifdef _WIN32
+    return _aligned_malloc(size, align);
+#else
+    return std::aligned_alloc(align, size);
+#endif
+}
+
+// The deletes below only ever free through these two. Once GCC inlines a delete into a caller that also inlined
+// the matching new it pairs free with operator new and warns (-Wmismatched-new-delete), so they stay out of line.
+#ifdef _MSC_VER
+#define NOINLINE __declspec(noinline)
+#else
+#define NOINLINE __attribute__((noinline))
+#endif
+
+static NOINLINE void plainFree(void* memory) noexcept {
+    std::free(memory);
+}
+
+static NOINLINE void alignedFree(void* memory) noexcept {
+#ifdef _WIN32
+    _aligned_free(memory);
+#else
+    std::free(memory);
+#endif
+}
+
+void* operator new(size_t size) {
+    if (void* memory = countedAllocate(size)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+    if (void* memory = countedAllocate(size)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+    if (void* memory = countedAllocate(size, alignment)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size, std::align_val_t alignment) {
+    if (void* memory = countedAllocate(size, alignment)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return countedAllocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return countedAllocate(size);
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return countedAllocate(size, alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return countedAllocate(size, alignment);
+}
+
+void operator delete(void* memory) noexcept {
+    plainFree(memory);
+}
+
+void operator delete[](void* memory) noexcept {
+    plainFree(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+    plainFree(memory);
+}
+
+void operator delete[](void* memory, size_t) noexcept {
+    plainFree(memory);
+}
+
+void operator delete(void* memory, const std::nothrow_t&) noexcept {
+    plainFree(memory);
+}
+
+void operator delete[](void* memory, const std::nothrow_t&) noexcept {
+    plainFree(memory);
+}
+
+void operator delete(void* memory, std::align_val_t) noexcept {
+    alignedFree(memory);
+}
+
+void operator delete[](void* memory, std::align_val_t) noexcept {
+    alignedFree(memory);
+}
+
+void operator delete(void* memory, size_t, std::align_val_t) noexcept {
+    alignedFree(memory);
+}
+
+void operator delete[](void* memory, size_t, std::align_val_t) noexcept {
+    alignedFree(memory);
+}
+
+void operator delete(void* memory, std::align_val_t, const std::nothrow_t&) noexcept {
+    alignedFree(memory);
+}
+
+void operator delete[](void* memory, std::align_val_t, const std::nothrow_t&) noexcept {
+    alignedFree(memory);
+}
+
+// Ticks run before counting in --check-allocations, so lazily grown buffers reach their working size
+const int ALLOCATION_WARMUP_TICKS = 10;
+
+// Largest change of TotalHeat over the measured ticks --check-heat accepts, relative to the total
+const double HEAT_DRIFT_TOLERANCE = 1e-9;
+
+struct HeadlessOptions {
+    std::string scenario = "lava_lake";
+    int ticks = 1000;
+    int warmup = 0;
+    unsigned int seed = 0;
+    int threads = 1;
+    bool threadsSet = false; // --threads was given, otherwise a replay runs on the recorded thread count
+    bool scaling = false; // Repeat the run with 1, 2, 4 ... threads up to --threads
+    bool checkAllocations = false; // Fail if a measured tick allocates
+    bool checkHeat = false; // Fail if the measured ticks change the total heat, meant for scenes without reactions
+    bool checkPaging = false; // Fail if a chunk comes back from the page file with lifetimes that ran out while it was away
+    std::string load; // Snapshot to start from instead of building the scenario
+    std::string save; // Snapshot written after the measured ticks
+    std::string replay; // Input log to replay instead of building the scenario, sets the seed and tick count
+    bool render = false; // Refresh a framebuffer after every tick, as the game does every frame
+    std::string dumpFrame; // PPM of the final state
+    std::string exportPath; // Directory for PNG frames, or the file for raw frames
+    int exportEvery = 1; // Export every Nth measured tick
+    ExportFormat exportFormat = ExportFormat::PNG;
+    int exportBuffers = 8; // Frames that can wait for the writer before new ones get dropped
+    int width = DEFAULT_GRID_WIDTH; // Grid size, the window onto the world when paging
+    int height = DEFAULT_GRID_HEIGHT;
+    int worldWidth = 0; // Paged world size, 0 runs the grid on its own
+    int worldHeight = 0;
+    std::string pageFile = "world.pages";
+    int pan = 4; // Cells per tick the focus travels across a paged world
+    std::string materials = DEFAULT_MATERIALS_PATH;
+    std::string profile; // CSV of the measured ticks, needs a SIM_PROFILING build
+    std::string trace; // Chrome trace of the measured ticks, needs a SIM_PROFILING build
+    bool velocity = false; // Move falling particles by velocity (see IntegrateVelocity)
+    bool margolus = false; // Move particles with the Margolus block engine (see Margolus.h)
+};
+
+// Log read for --replay
+static InputLog replayLog;
+
+// Feeds the commands of replayLog to the simulation, each before the tick it was issued on
+struct ReplayCursor {
+    const InputLog* log = nullptr;
+    size_t next = 0;
+    uint32_t tick = 0;
+
+    void step() {
+        while (log != nullptr && next < log->entries.size() && log->entries[next].tick <= tick) {
+            ApplyCommand(log->entries[next].command);
+            next++;
+        }
+        UpdateParticles();
+        tick++;
+    }
+};
+
+// Totals over the measured ticks of one run
+struct RunResult {
+    double seconds = 0.0;
+    TickTimings phaseTotals;
+    int particles = 0;
+    int awakeChunks = 0;
+    size_t allocations = 0; // operator new calls during the measured ticks
+    double heatDrift = 0.0; // Change of TotalHeat over the measured ticks, relative to where it started
+    int overdueLifetimes = 0; // Found after window moves in --check-paging, warmup included
+    double renderSeconds = 0.0; // Spent refreshing the framebuffer and handing frames to the exporter, not included in seconds
+    ExportStats exportStats;
+    PagerStats pagerStats; // Paging time is not included in seconds either
+    uint64_t worldHash = 0; // Of the world the run ended in, see hashWorld
+};
+
+static void printUsage() {
+    std::cout << "Usage: Headless [--scenario name] [--ticks N] [--warmup N] [--seed N] [--threads N] [--scaling] [--check-allocations] [--check-heat] [--check-paging] [--load path] [--save path] [--replay path] [--render] [--dump-frame path]" << std::endl;
+    std::cout << "                [--export path] [--export-every N] [--export-format png|raw] [--export-buffers N] [--size WxH]" << std::endl;
+    std::cout << "                [--world WxH] [--page-file path] [--pan N] [--materials path] [--profile path] [--trace path] [--velocity] [--margolus] [--list]" << std::endl;
+}
+
+// Reads "WxH", both sides between 1 and maxSide
+static bool parseSize(const std::string& text, int maxSide, int& width, int& height) {
+    size_t separator = text.find('x');
+    if (separator == std::string::npos) {
+        return false;
+    }
+    long w = std::strtol(text.c_str(), nullptr, 10);
+    long h = std::strtol(text.c_str() + separator + 1, nullptr, 10);
+    if (w < 1 || h < 1 || w > maxSide || h > maxSide) {
+        return false;
+    }
+    width = int(w);
+    height = int(h);
+    return true;
+}
+
+static void printScenarios() {
+    for (const Scenario& scenario : getScenarios()) {
+        std::cout << "  " << scenario.name << " - " << scenario.description << std::endl;
+    }
+}
+
+static bool parseArguments(int argc, char** argv, HeadlessOptions& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--scenario" && hasValue) {
+            options.scenario = argv[++i];
+        }
+        else if (arg == "--ticks" && hasValue) {
+            options.ticks = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (arg == "--warmup" && hasValue) {
+            options.warmup = std::max(0, std::atoi(argv[++i]));
+        }
+        else if (arg == "--seed" && hasValue) {
+            options.seed = unsigned(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--threads" && hasValue) {
+            options.threads = std::max(1, std::atoi(argv[++i]));
+            options.threadsSet = true;
+        }
+        else if (arg == "--scaling") {
+            options.scaling = true;
+        }
+        else if (arg == "--check-allocations") {
+            options.checkAllocations = true;
+        }
+        else if (arg == "--check-heat") {
+            options.checkHeat = true;
+        }
+        else if (arg == "--check-paging") {
+            options.checkPaging = true;
+        }
+        else if (arg == "--load" && hasValue) {
+            options.load = argv[++i];
+        }
+        else if (arg == "--save" && hasValue) {
+            options.save = argv[++i];
+        }
+        else if (arg == "--replay" && hasValue) {
+            options.replay = argv[++i];
+        }
+        else if (arg == "--render") {
+            options.render = true;
+        }
+        else if (arg == "--dump-frame" && hasValue) {
+            options.dumpFrame = argv[++i];
+        }
+        else if (arg == "--export" && hasValue) {
+            options.exportPath = argv[++i];
+        }
+        else if (arg == "--export-every" && hasValue) {
+            options.exportEvery = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (arg == "--export-format" && hasValue) {
+            std::string format = argv[++i];
+            if (format == "png") {
+                options.exportFormat = ExportFormat::PNG;
+            }
+            else if (format == "raw") {
+                options.exportFormat = ExportFormat::RAW;
+            }
+            else {
+                printUsage();
+                return false;
+            }
+        }
+        else if (arg == "--export-buffers" && hasValue) {
+            options.exportBuffers = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (arg == "--size" && hasValue) {
+            if (!parseSize(argv[++i], MAX_GRID_SIDE, options.width, options.height)) {
+                std::cerr << "--size takes WxH with sides up to " << MAX_GRID_SIDE << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--world" && hasValue) {
+            if (!parseSize(argv[++i], 1 << 30, options.worldWidth, options.worldHeight)) {
+                std::cerr << "--world takes WxH" << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--page-file" && hasValue) {
+            options.pageFile = argv[++i];
+        }
+        else if (arg == "--pan" && hasValue) {
+            options.pan = std::max(0, std::atoi(argv[++i]));
+        }
+        else if (arg == "--materials" && hasValue) {
+            options.materials = argv[++i];
+        }
+        else if (arg == "--velocity") {
+            options.velocity = true;
+        }
+        else if (arg == "--margolus") {
+            options.margolus = true;
+        }
+        else if ((arg == "--profile" || arg == "--trace") && hasValue) {
+#ifdef SIM_PROFILING
+            (arg == "--profile" ? options.profile : options.trace) = argv[++i];
+#else
+            std::cerr << arg << " needs a build with SIM_PROFILING defined" << std::endl;
+            return false;
+#endif
+        }
+        else if (arg == "--list") {
+            printScenarios();
+            return false;
+        }
+        else {
+            printUsage();
+            return false;
+        }
+    }
+    return true;
+}
+
+// Where a run starts from, for the report
+static std::string describeStart(const Scenario& scenario, const HeadlessOptions& options) {
+    if (!options.replay.empty()) {
+        return "replay " + options.replay + " (seed " + std::to_string(options.seed) + ")";
+    }
+    if (!options.load.empty()) {
+        return "snapshot " + options.load;
+    }
+    return scenario.name + " (seed " + std::to_string(options.seed) + ")";
+}
+
+// Walks back and forth over [0, range)
+static int pingPong(int64_t position, int range) {
+    if (range <= 1) {
+        return 0;
+    }
+    int64_t phase = position % (2 * int64_t(range - 1));
+    return int(phase < range ? phase : 2 * int64_t(range - 1) - phase);
+}
+
+// The focus starts in the middle of the window and travels diagonally across the world and back, pan cells per tick
+// Lifetimes that should have run out already
+// Every tick expires whatever is due on it, so between ticks no expiry lies further back than the tick just run.
+static int countOverdueLifetimes() {
+    int overdue = 0;
+    for (int y = 0; y < grid.getHeight(); y++) {
+        for (int x = 0; x < grid.getWidth(); x++) {
+            uint32_t expiry = grid.expiryTick(x, y);
+            overdue += expiry != NO_EXPIRY && expiry + 1 < simulationTick;
+        }
+    }
+    return overdue;
+}
+
+// With --check-paging every window move adds the lifetimes the chunks it brought back should have lost to overdue
+static bool panFocus(WorldPager& pager, const HeadlessOptions& options, int tick, int& overdue) {
+    if (!pager.isOpen()) {
+        return true;
+    }
+    int64_t travelled = int64_t(tick) * options.pan;
+    int moves = pager.getStats().moves;
+    if (!pager.focus(grid.getWidth() / 2 + pingPong(travelled, pager.getWorldWidth() - grid.getWidth()),
+        grid.getHeight() / 2 + pingPong(travelled, pager.getWorldHeight() - grid.getHeight()))) {
+        return false;
+    }
+    if (options.checkPaging && pager.getStats().moves != moves) {
+        overdue += countOverdueLifetimes();
+    }
+    return true;
+}
+
+// FNV-1a over the type, temperature and expiry of every cell, equal for runs that ended in the same world
+static uint64_t hashWorld() {
+    uint64_t hash = 14695981039346656037ull;
+    auto add = [&hash](const void* data, size_t size) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; i++) {
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        }
+    };
+
+    for (int y = 0; y < grid.getHeight(); y++) {
+        for (int x = 0; x < grid.getWidth(); x++) {
+            ParticleType type = grid.type(x, y);
+            double temperature = grid.temperature(x, y);
+            uint32_t expiry = grid.expiryTick(x, y);
+            add(&type, sizeof(type));
+            add(&temperature, sizeof(temperature));
+            add(&expiry, sizeof(expiry));
+        }
+    }
+    return hash;
+}
+
+// Rebuild the scenario from the seed (or load the snapshot, or replay the input log) and time the requested number of ticks
+static bool runScenario(const Scenario& scenario, const HeadlessOptions& options, int threads, RunResult& result) {
+    SetSimulationThreads(threads);
+    velocityMovement = options.velocity;
+    SetMovementNeighbourhood(options.margolus ? NeighborhoodType::Margolus : NeighborhoodType::Moore);
+    RandomDevice::reseed(options.seed);
+    InitializeSimulation();
+    if (options.width != grid.getWidth() || options.height != grid.getHeight()) {
+        ResizeWorld(options.width, options.height);
+    }
+
+    ReplayCursor replay;
+    if (!options.replay.empty()) {
+        replay.log = &replayLog;
+    }
+    else if (!options.load.empty()) {
+        if (!LoadSnapshot(options.load)) {
+            return false;
+        }
+    }
+    else {
+        scenario.build();
+    }
+
+    // The grid as built becomes the bottom left corner of the paged world
+    WorldPager pager;
+    if (options.worldWidth > 0 && !pager.open(options.pageFile, options.worldWidth, options.worldHeight, 0, 0)) {
+        return false;
+    }
+
+    int overdueLifetimes = 0;
+    int warmup = options.checkAllocations ? std::max(options.warmup, ALLOCATION_WARMUP_TICKS) : options.warmup;
+    for (int i = 0; i < warmup; i++) {
+        if (!panFocus(pager, options, i, overdueLifetimes)) {
+            return false;
+        }
+        replay.step();
+    }
+
+    // Frames only come from the measured ticks, the writer thread is running before they start
+    std::unique_ptr<FrameExporter> exporter;
+    if (!options.exportPath.empty()) {
+        exporter = std::make_unique<FrameExporter>(grid.getWidth(), grid.getHeight(), options.exportFormat, options.exportPath, options.exportBuffers);
+        if (!exporter->isOpen()) {
+            return false;
+        }
+    }
+
+    CellFramebuffer framebuffer(grid);
+    if (options.render || exporter) {
+        framebuffer.refresh(grid);
+    }
+
+#ifdef SIM_PROFILING
+    // Room for the scopes of every measured tick, the framebuffer refresh included
+    Profiler::reset(size_t(options.ticks), size_t(options.ticks) * (size_t(Profiler::Scope::COUNT) + 1));
+#endif
+
+    result = RunResult();
+    PagerStats pagerBefore = pager.getStats();
+    size_t allocationsBefore = allocationCount.load();
+    double heatBefore = TotalHeat();
+    auto runStart = std::chrono::steady_clock::now();
+    for (int i = 0; i < options.ticks; i++) {
+        if (!panFocus(pager, options, warmup + i, overdueLifetimes)) {
+            return false;
+        }
+        replay.step();
+        result.phaseTotals.heat += lastTickTimings.heat;
+        result.phaseTotals.preActions += lastTickTimings.preActions;
+        result.phaseTotals.movement += lastTickTimings.movement;
+        result.phaseTotals.postActions += lastTickTimings.postActions;
+        result.phaseTotals.updatedCells += lastTickTimings.updatedCells;
+
+        bool exportTick = exporter && i % options.exportEvery == 0;
+        if (options.render || exportTick) {
+            auto renderStart = std::chrono::steady_clock::now();
+            PROFILE_SCOPE(RENDER);
+            framebuffer.refresh(grid);
+            if (exportTick) {
+                exporter->submit(framebuffer, simulationTick);
+            }
+            result.renderSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - renderStart).count();
+        }
+    }
+    result.allocations = allocationCount.load() - allocationsBefore;
+    result.heatDrift = (TotalHeat() - heatBefore) / std::max(std::abs(heatBefore), 1.0);
+    result.overdueLifetimes = overdueLifetimes;
+    result.pagerStats = pager.getStats();
+    result.pagerStats.moves -= pagerBefore.moves;
+    result.pagerStats.pagesOut -= pagerBefore.pagesOut;
+    result.pagerStats.pagesIn -= pagerBefore.pagesIn;
+    result.pagerStats.pagesCreated -= pagerBefore.pagesCreated;
+    result.pagerStats.bytesWritten -= pagerBefore.bytesWritten;
+    result.pagerStats.bytesRead -= pagerBefore.bytesRead;
+    result.pagerStats.seconds -= pagerBefore.seconds;
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - runStart).count() - result.renderSeconds
+        - result.pagerStats.seconds;
+
+    // Whatever is still queued gets written after the timing stopped
+    if (exporter) {
+        exporter->finish();
+        result.exportStats = exporter->getStats();
+    }
+    result.particles = grid.countParticles();
+    result.awakeChunks = grid.chunks.countAwake();
+    result.worldHash = hashWorld();
+    return true;
+}
+
+static void printRun(const Scenario& scenario, const HeadlessOptions& options, const RunResult& result) {
+    double cells = double(grid.getWidth()) * grid.getHeight() * options.ticks;
+
+    std::cout << "scenario:      " << describeStart(scenario, options) << ", " << grid.getWidth() << "x" << grid.getHeight() << std::endl;
+    if (options.worldWidth > 0) {
+        std::cout << "world:         " << options.worldWidth << "x" << options.worldHeight << " paged through " << options.pageFile
+            << ", focus moving " << options.pan << " cells/tick" << std::endl;
+    }
+    std::cout << "ticks:         " << options.ticks << " (+" << options.warmup << " warmup)" << std::endl;
+    std::cout << "threads:       " << simulationThreads << std::endl;
+    std::cout << "particles:     " << result.particles << std::endl;
+    std::cout << "awake chunks:  " << result.awakeChunks << "/" << grid.chunks.getChunksX() * grid.chunks.getChunksY() << std::endl;
+    std::cout << "updated/tick:  " << result.phaseTotals.updatedCells / options.ticks << " cells" << std::endl;
+    std::cout << "ms/tick:       " << to_string_rounded(result.seconds * 1000.0 / options.ticks, 4) << std::endl;
+    std::cout << "cells/sec:     " << to_string_rounded(cells / result.seconds, 0) << std::endl;
+    std::cout << "heat:          " << to_string_rounded(result.phaseTotals.heat / options.ticks, 4) << " ms/tick" << std::endl;
+    std::cout << "pre-actions:   " << to_string_rounded(result.phaseTotals.preActions / options.ticks, 4) << " ms/tick" << std::endl;
+    std::cout << "movement:      " << to_string_rounded(result.phaseTotals.movement / options.ticks, 4) << " ms/tick" << std::endl;
+    std::cout << "post-actions:  " << to_string_rounded(result.phaseTotals.postActions / options.ticks, 4) << " ms/tick" << std::endl;
+    if (options.render || !options.exportPath.empty()) {
+        std::cout << "render:        " << to_string_rounded(result.renderSeconds * 1000.0 / options.ticks, 4) << " ms/tick" << std::endl;
+    }
+    if (!options.exportPath.empty()) {
+        const ExportStats& stats = result.exportStats;
+        int writes = std::max(1, stats.written + stats.failed);
+        std::cout << "export:        " << stats.written << "/" << stats.submitted << " frames written, " << stats.dropped << " dropped, "
+            << stats.failed << " failed, at most " << stats.maxQueued << " queued" << std::endl;
+        std::cout << "export time:   " << to_string_rounded(stats.encodeSeconds * 1000.0 / writes, 4) << " ms encode, "
+            << to_string_rounded(stats.writeSeconds * 1000.0 / writes, 4) << " ms write per frame" << std::endl;
+    }
+    if (options.worldWidth > 0) {
+        const PagerStats& stats = result.pagerStats;
+        std::cout << "paging:        " << stats.moves << " moves, " << stats.pagesOut << " chunks out, " << stats.pagesIn << " in, "
+            << stats.pagesCreated << " new" << std::endl;
+        std::cout << "paging I/O:    " << to_string_rounded(stats.bytesWritten / 1048576.0, 2) << " MB written, "
+            << to_string_rounded(stats.bytesRead / 1048576.0, 2) << " MB read, page file " << to_string_rounded(stats.fileBytes / 1048576.0, 2)
+            << " MB, " << to_string_rounded(stats.seconds * 1000.0 / std::max(1, stats.moves), 4) << " ms/move" << std::endl;
+    }
+    if (options.checkPaging) {
+        std::cout << "overdue:       " << result.overdueLifetimes << " lifetimes after window moves" << std::endl;
+    }
+    std::cout << "allocations:   " << result.allocations << std::endl;
+    if (options.checkHeat) {
+        std::cout << "heat drift:    " << result.heatDrift << std::endl;
+    }
+}
+
+static bool printScaling(const Scenario& scenario, const HeadlessOptions& options) {
+    std::cout << "scaling:       " << describeStart(scenario, options) << ", " << options.ticks << " ticks, "
+        << std::thread::hardware_concurrency() << " hardware threads" << std::endl;
+    std::cout << "threads    ms/tick    speedup    efficiency    world" << std::endl;
+
+    // Without an explicit --threads the sweep goes up to the hardware thread count
+    int maxThreads = options.threads > 1 ? options.threads : std::max(1, int(std::thread::hardware_concurrency()));
+
+    // Every run has to end in the same world as the first one that took the same update path: Margolus blocks
+    // come out the same on any thread count, the chunk passes only match other parallel runs
+    double serialMs = 0.0;
+    uint64_t serialHash = 0;
+    uint64_t parallelHash = 0;
+    bool deterministic = true;
+    for (int threads = 1; ; threads = std::min(threads * 2, maxThreads)) {
+        RunResult result;
+        if (!runScenario(scenario, options, threads, result)) {
+            return false;
+        }
+        double ms = result.seconds * 1000.0 / options.ticks;
+        if (threads == 1) {
+            serialMs = ms;
+        }
+
+        uint64_t& reference = threads > 1 && !options.margolus ? parallelHash : serialHash;
+        if (reference == 0) {
+            reference = result.worldHash;
+        }
+        bool same = result.worldHash == reference;
+        deterministic = deterministic && same;
+
+        double speedup = serialMs / ms;
+        std::cout << std::setw(7) << threads << std::setw(11) << to_string_rounded(ms, 4)
+            << std::setw(10) << to_string_rounded(speedup, 2) << "x" << std::setw(13) << to_string_rounded(100.0 * speedup / threads, 1) << "%"
+            << std::setw(9) << (same ? "same" : "differs") << std::endl;
+
+        if (threads == maxThreads) {
+            break;
+        }
+    }
+
+    if (!deterministic) {
+        std::cerr << "Determinism check failed: runs on different thread counts ended in different worlds" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    HeadlessOptions options;
+    if (!parseArguments(argc, argv, options)) {
+        return 1;
+    }
+
+    const Scenario* scenario = findScenario(options.scenario);
+    if (scenario == nullptr) {
+        std::cerr << "Unknown scenario: " << options.scenario << std::endl;
+        printScenarios();
+        return 1;
+    }
+
+    if (!LoadMaterials(options.materials)) {
+        return 1;
+    }
+
+    if (!options.replay.empty()) {
+        if (!LoadInputLog(options.replay, replayLog)) {
+            return 1;
+        }
+
+        // The log decides the seed and how long the run is, the warmup ticks are the first ones of the log
+        options.seed = replayLog.seed;
+        options.ticks = std::max(1, int(replayLog.ticks) - options.warmup);
+        if (!options.threadsSet) {
+            options.threads = replayLog.threads;
+        }
+        if ((options.threads > 1) != (replayLog.threads > 1)) {
+            std::cerr << "Replaying on " << options.threads << " threads a session recorded on " << replayLog.threads
+                << ", the serial and parallel updates differ so the run won't match the recording" << std::endl;
+        }
+    }
+
+    if (options.scaling) {
+        if (!printScaling(*scenario, options)) {
+            return 1;
+        }
+    }
+    else {
+        RunResult result;
+        if (!runScenario(*scenario, options, options.threads, result)) {
+            return 1;
+        }
+        printRun(*scenario, options, result);
+
+        if (options.checkAllocations && result.allocations > 0) {
+            std::cerr << "Allocation check failed: " << result.allocations << " allocations during " << options.ticks << " ticks" << std::endl;
+            return 1;
+        }
+        if (options.checkHeat && std::abs(result.heatDrift) > HEAT_DRIFT_TOLERANCE) {
+            std::cerr << "Heat check failed: the total heat drifted by " << result.heatDrift << " of itself during " << options.ticks << " ticks" << std::endl;
+            return 1;
+        }
+        if (options.checkPaging && result.overdueLifetimes > 0) {
+            std::cerr << "Paging check failed: chunks came back from the page file with " << result.overdueLifetimes << " lifetimes already run out" << std::endl;
+            return 1;
+        }
+    }
+
+#ifdef SIM_PROFILING
+    // Profiles cover the measured ticks of the last run
+    if (!options.profile.empty() && !Profiler::writeCsv(options.profile)) {
+        return 1;
+    }
+    if (!options.trace.empty() && !Profiler::writeTrace(options.trace)) {
+        return 1;
+    }
+    if (Profiler::getDroppedRecords() > 0) {
+        std::cerr << "Profiler ran out of room, " << Profiler::getDroppedRecords() << " ticks and scopes were dropped" << std::endl;
+    }
+#endif
+
+    // Saved from the state the last run ended in
+    if (!options.save.empty() && !SaveSnapshot(options.save)) {
+        return 1;
+    }
+    if (!options.dumpFrame.empty()) {
+        CellFramebuffer frame(grid);
+        frame.refresh(grid);
+        if (!frame.writePPM(options.dumpFrame)) {
+            return 1;
+        }
+    }
+    return 0;
+}
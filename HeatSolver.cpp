@@ -0,0 +1,369 @@
+#include "HeatSolver.h"
+#include "ThreadPool.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+// Rows handed to one pool task at a time
+const int HEAT_ROWS_PER_TASK = 8;
+
+// Per type conductivity and heat capacity, non-conducting types are k = 0, c = 1
+static std::array<double, size_t(MAX_MATERIALS)> conductivityByType;
+static std::array<double, size_t(MAX_MATERIALS)> capacityByType;
+
+// Row-major planes matching the grid
+static std::vector<double> conductivities;
+static std::vector<double> capacities;
+static std::vector<double> inverseNeighbourCounts;
+static std::vector<double> heatDeltas;
+
+// Per chunk flags for the current step, row by row like the chunks themselves
+// The stencil runs in the solved chunks and reads the material constants one cell past them, so those are
+// prepared for every chunk around a solved one as well. The cells of those border chunks that touch a solved
+// chunk take their side of every exchange with it, so no heat is lost across the edge of the solved region.
+static std::vector<uint8_t> solvedChunks;
+static std::vector<uint8_t> preparedChunks;
+static std::vector<uint8_t> borderChunks;
+static std::vector<uint8_t> changedChunks;
+static std::vector<uint8_t> activeChunks;
+
+// Whether a row of a chunk changed by HEAT_SLEEP_THRESHOLD or more, one flag per row and chunk column
+// Every row belongs to a single task, so tasks never write the same flag.
+static std::vector<uint8_t> changedRowSpans;
+
+void InitializeHeatSolver() {
+    for (int i = 0; i < materialCount; i++) {
+        const generalParticleData& data = getMaterial(ParticleType(i));
+        bool conducts = data.thermalConductivity > 0 && data.specificHeatCapacity > 0;
+        conductivityByType[i] = conducts ? data.thermalConductivity : 0.0;
+        capacityByType[i] = conducts ? data.specificHeatCapacity : 1.0;
+    }
+
+    int width = grid.getWidth();
+    int height = grid.getHeight();
+    size_t cells = size_t(width) * height;
+    conductivities.assign(cells, 0.0);
+    capacities.assign(cells, 1.0);
+    heatDeltas.assign(cells, 0.0);
+
+    size_t chunks = size_t(grid.chunks.getChunksX()) * grid.chunks.getChunksY();
+    solvedChunks.assign(chunks, 0);
+    preparedChunks.assign(chunks, 0);
+    borderChunks.assign(chunks, 0);
+    changedChunks.assign(chunks, 0);
+    activeChunks.assign(chunks, 0);
+    changedRowSpans.assign(size_t(height) * grid.chunks.getChunksX(), 0);
+
+    // Same count getMooreNeighbours returns: 8 inside, 5 along an edge, 3 in a corner
+    inverseNeighbourCounts.resize(cells);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int columns = 1 + (x > 0) + (x < width - 1);
+            int rows = 1 + (y > 0) + (y < height - 1);
+            inverseNeighbourCounts[grid.index(x, y)] = 1.0 / (columns * rows - 1);
+        }
+    }
+}
+
+// Copy the material constants of cells [firstX, lastX) of row y into the k and c planes
+static void prepareSpan(int y, int firstX, int lastX) {
+    const ParticleType* types = grid.typePlane();
+    for (size_t i = grid.index(firstX, y); i < grid.index(lastX, y); i++) {
+        conductivities[i] = conductivityByType[size_t(types[i])];
+        capacities[i] = capacityByType[size_t(types[i])];
+    }
+}
+
+static bool inSolvedChunk(int x, int y) {
+    return solvedChunks[size_t(y / CHUNK_SIZE) * grid.chunks.getChunksX() + x / CHUNK_SIZE] != 0;
+}
+
+// Scalar stencil for one cell, handles the grid border
+// A cell outside the solved chunks only exchanges heat with its neighbours inside them (solvedOnly).
+static double cellHeatDelta(int x, int y, bool solvedOnly = false) {
+    const double* temperatures = grid.temperaturePlane();
+    size_t i = grid.index(x, y);
+    if (conductivities[i] == 0.0) {
+        return 0.0;
+    }
+
+    double sum = 0.0;
+    for (int dy = -1; dy <= 1; dy++) {
+        for (int dx = -1; dx <= 1; dx++) {
+            if ((dx == 0 && dy == 0) || !isValidIndex(x + dx, y + dy) || (solvedOnly && !inSolvedChunk(x + dx, y + dy))) {
+                continue;
+            }
+
+            size_t j = grid.index(x + dx, y + dy);
+            sum += std::min(conductivities[i], conductivities[j]) * (temperatures[j] - temperatures[i])
+                * capacities[j] / (capacities[i] + capacities[j]) * (inverseNeighbourCounts[i] + inverseNeighbourCounts[j]);
+        }
+    }
+    return 0.5 * sum / capacities[i];
+}
+
+// Fill heatDeltas for cells [firstX, lastX) of row y, the inner cells of inner rows go through the vector kernel
+static void computeSpan(int y, int firstX, int lastX) {
+    const double* temperatures = grid.temperaturePlane();
+    const int width = grid.getWidth();
+
+    if (y == 0 || y == grid.getHeight() - 1) {
+        for (int x = firstX; x < lastX; x++) {
+            heatDeltas[grid.index(x, y)] = cellHeatDelta(x, y);
+        }
+        return;
+    }
+
+    int x = firstX;
+    if (x == 0) {
+        heatDeltas[grid.index(0, y)] = cellHeatDelta(0, y);
+        x = 1;
+    }
+
+    const int vectorEnd = std::min(lastX, width - 1);
+    size_t row = grid.index(0, y);
+    const ptrdiff_t offsets[8] = {
+        -width - 1, -width, -width + 1,
+        -1, 1,
+        width - 1, width, width + 1
+    };
+
+#if defined(__AVX2__)
+    const __m256d half = _mm256_set1_pd(0.5);
+    for (; x + 4 <= vectorEnd; x += 4) {
+        size_t i = row + x;
+        __m256d ki = _mm256_loadu_pd(&conductivities[i]);
+
+        // Blocks without a conducting cell (mostly empty space) can't change
+        if (_mm256_movemask_pd(_mm256_cmp_pd(ki, _mm256_setzero_pd(), _CMP_GT_OQ)) == 0) {
+            _mm256_storeu_pd(&heatDeltas[i], _mm256_setzero_pd());
+            continue;
+        }
+
+        __m256d ci = _mm256_loadu_pd(&capacities[i]);
+        __m256d ti = _mm256_loadu_pd(&temperatures[i]);
+        __m256d ni = _mm256_loadu_pd(&inverseNeighbourCounts[i]);
+
+        __m256d sum = _mm256_setzero_pd();
+        for (ptrdiff_t offset : offsets) {
+            size_t j = i + offset;
+            __m256d kj = _mm256_loadu_pd(&conductivities[j]);
+            __m256d cj = _mm256_loadu_pd(&capacities[j]);
+            __m256d tj = _mm256_loadu_pd(&temperatures[j]);
+            __m256d nj = _mm256_loadu_pd(&inverseNeighbourCounts[j]);
+
+            __m256d term = _mm256_mul_pd(_mm256_min_pd(ki, kj), _mm256_sub_pd(tj, ti));
+            term = _mm256_div_pd(_mm256_mul_pd(term, cj), _mm256_add_pd(ci, cj));
+            sum = _mm256_add_pd(sum, _mm256_mul_pd(term, _mm256_add_pd(ni, nj)));
+        }
+        _mm256_storeu_pd(&heatDeltas[i], _mm256_div_pd(_mm256_mul_pd(half, sum), ci));
+    }
+#elif defined(__SSE2__) || defined(_M_X64)
+    const __m128d half = _mm_set1_pd(0.5);
+    for (; x + 2 <= vectorEnd; x += 2) {
+        size_t i = row + x;
+        __m128d ki = _mm_loadu_pd(&conductivities[i]);
+
+        // Blocks without a conducting cell (mostly empty space) can't change
+        if (_mm_movemask_pd(_mm_cmpgt_pd(ki, _mm_setzero_pd())) == 0) {
+            _mm_storeu_pd(&heatDeltas[i], _mm_setzero_pd());
+            continue;
+        }
+
+        __m128d ci = _mm_loadu_pd(&capacities[i]);
+        __m128d ti = _mm_loadu_pd(&temperatures[i]);
+        __m128d ni = _mm_loadu_pd(&inverseNeighbourCounts[i]);
+
+        __m128d sum = _mm_setzero_pd();
+        for (ptrdiff_t offset : offsets) {
+            size_t j = i + offset;
+            __m128d kj = _mm_loadu_pd(&conductivities[j]);
+            __m128d cj = _mm_loadu_pd(&capacities[j]);
+            __m128d tj = _mm_loadu_pd(&temperatures[j]);
+            __m128d nj = _mm_loadu_pd(&inverseNeighbourCounts[j]);
+
+            __m128d term = _mm_mul_pd(_mm_min_pd(ki, kj), _mm_sub_pd(tj, ti));
+            term = _mm_div_pd(_mm_mul_pd(term, cj), _mm_add_pd(ci, cj));
+            sum = _mm_add_pd(sum, _mm_mul_pd(term, _mm_add_pd(ni, nj)));
+        }
+        _mm_storeu_pd(&heatDeltas[i], _mm_div_pd(_mm_mul_pd(half, sum), ci));
+    }
+#else
+    (void)offsets;
+    (void)temperatures;
+    (void)vectorEnd;
+#endif
+
+    // Remainder that doesn't fill a whole vector, plus the right border
+    for (; x < lastX; x++) {
+        heatDeltas[grid.index(x, y)] = cellHeatDelta(x, y);
+    }
+}
+
+// Call visit(x) for the cells of row y in [firstX, lastX) on the outline of their chunk
+// Only these can neighbour another chunk.
+template<typename Visit>
+static void forEachOutlineCell(int y, int firstX, int lastX, Visit visit) {
+    int firstRow = y / CHUNK_SIZE * CHUNK_SIZE;
+    int lastRow = std::min(firstRow + CHUNK_SIZE, grid.getHeight()) - 1;
+    if (y == firstRow || y == lastRow) {
+        for (int x = firstX; x < lastX; x++) {
+            visit(x);
+        }
+        return;
+    }
+    visit(firstX);
+    if (lastX - 1 > firstX) {
+        visit(lastX - 1);
+    }
+}
+
+// Fill heatDeltas for the cells of a border chunk in [firstX, lastX) of row y that could touch a solved chunk
+static void computeBorderSpan(int y, int firstX, int lastX) {
+    forEachOutlineCell(y, firstX, lastX, [&](int x) {
+        heatDeltas[grid.index(x, y)] = cellHeatDelta(x, y, true);
+    });
+}
+
+// Add the heat delta of one cell to its temperature and keep it awake if it changes noticeably
+// Returns whether it did.
+static bool applyCell(double* temperatures, int x, int y) {
+    size_t i = grid.index(x, y);
+    if (heatDeltas[i] == 0.0) {
+        return false;
+    }
+
+    temperatures[i] += heatDeltas[i];
+    if (std::abs(heatDeltas[i]) < HEAT_SLEEP_THRESHOLD) {
+        return false;
+    }
+    grid.chunks.markDirty(x, y);
+    return true;
+}
+
+// Add heatDeltas to the temperatures of cells [firstX, lastX) of row y and keep changing cells awake
+static void applySpan(int y, int firstX, int lastX) {
+    double* temperatures = grid.temperaturePlane();
+    bool changed = false;
+    for (int x = firstX; x < lastX; x++) {
+        changed = applyCell(temperatures, x, y) || changed;
+    }
+    changedRowSpans[size_t(y) * grid.chunks.getChunksX() + firstX / CHUNK_SIZE] = changed;
+}
+
+// applySpan for the cells computeBorderSpan filled
+static void applyBorderSpan(int y, int firstX, int lastX) {
+    double* temperatures = grid.temperaturePlane();
+    bool changed = false;
+    forEachOutlineCell(y, firstX, lastX, [&](int x) {
+        changed = applyCell(temperatures, x, y) || changed;
+    });
+    changedRowSpans[size_t(y) * grid.chunks.getChunksX() + firstX / CHUNK_SIZE] = changed;
+}
+
+// Call stage on the part of every row in [firstRow, lastRow) that lies in a chunk flagged in mask
+static void forEachSpan(int firstRow, int lastRow, const std::vector<uint8_t>& mask, void (*stage)(int, int, int)) {
+    const int width = grid.getWidth();
+    const int chunksX = grid.chunks.getChunksX();
+    for (int y = firstRow; y < lastRow; y++) {
+        const uint8_t* chunkRow = &mask[size_t(y / CHUNK_SIZE) * chunksX];
+        for (int cx = 0; cx < chunksX; cx++) {
+            if (chunkRow[cx]) {
+                stage(y, cx * CHUNK_SIZE, std::min((cx + 1) * CHUNK_SIZE, width));
+            }
+        }
+    }
+}
+
+// Flag every chunk within one chunk of a flagged chunk of from in to, to is cleared first
+static void flagNeighbourhoods(const std::vector<uint8_t>& from, std::vector<uint8_t>& to) {
+    const int chunksX = grid.chunks.getChunksX();
+    const int chunksY = grid.chunks.getChunksY();
+    std::fill(to.begin(), to.end(), 0);
+    for (int cy = 0; cy < chunksY; cy++) {
+        for (int cx = 0; cx < chunksX; cx++) {
+            if (!from[size_t(cy) * chunksX + cx]) {
+                continue;
+            }
+            for (int ny = std::max(cy - 1, 0); ny <= std::min(cy + 1, chunksY - 1); ny++) {
+                for (int nx = std::max(cx - 1, 0); nx <= std::min(cx + 1, chunksX - 1); nx++) {
+                    to[size_t(ny) * chunksX + nx] = 1;
+                }
+            }
+        }
+    }
+}
+
+double TotalHeat() {
+    const ParticleType* types = grid.typePlane();
+    const double* temperatures = grid.temperaturePlane();
+    double total = 0.0;
+    for (size_t i = 0; i < size_t(grid.getWidth()) * grid.getHeight(); i++) {
+        if (conductivityByType[size_t(types[i])] > 0.0) {
+            total += capacityByType[size_t(types[i])] * temperatures[i];
+        }
+    }
+    return total;
+}
+
+void SolveHeat(WorkStealingPool* pool) {
+    const int height = grid.getHeight();
+    const int chunksX = grid.chunks.getChunksX();
+    const int chunksY = grid.chunks.getChunksY();
+    const int tasks = (height + HEAT_ROWS_PER_TASK - 1) / HEAT_ROWS_PER_TASK;
+
+    // Heat only moves in awake chunks and the ones it was still spreading through last step
+    for (int cy = 0; cy < chunksY; cy++) {
+        for (int cx = 0; cx < chunksX; cx++) {
+            solvedChunks[size_t(cy) * chunksX + cx] = grid.chunks.isAwake(cx, cy) || grid.chunks.isThermallyActive(cx, cy);
+        }
+    }
+    flagNeighbourhoods(solvedChunks, preparedChunks);
+    for (size_t i = 0; i < borderChunks.size(); i++) {
+        borderChunks[i] = preparedChunks[i] && !solvedChunks[i];
+    }
+
+    // Every stage reads the rows around its own, so each one finishes over the whole grid before the next
+    auto runStage = [&](const std::vector<uint8_t>& mask, void (*stage)(int, int, int)) {
+        auto runTask = [&](int task) {
+            forEachSpan(task * HEAT_ROWS_PER_TASK, std::min((task + 1) * HEAT_ROWS_PER_TASK, height), mask, stage);
+        };
+
+        if (pool) {
+            pool->parallelFor(tasks, runTask);
+        }
+        else {
+            for (int task = 0; task < tasks; task++) {
+                runTask(task);
+            }
+        }
+    };
+
+    runStage(preparedChunks, prepareSpan);
+    runStage(solvedChunks, computeSpan);
+    runStage(borderChunks, computeBorderSpan);
+
+    std::fill(changedRowSpans.begin(), changedRowSpans.end(), 0);
+    grid.setConcurrentWrites(pool != nullptr);
+    runStage(solvedChunks, applySpan);
+    runStage(borderChunks, applyBorderSpan);
+    grid.setConcurrentWrites(false);
+
+    // A chunk keeps conducting while it or one of its neighbours changed by HEAT_SLEEP_THRESHOLD or more,
+    // border chunks included, so heat flowing out of the solved region carries on into them next step
+    std::fill(changedChunks.begin(), changedChunks.end(), 0);
+    for (int y = 0; y < height; y++) {
+        for (int cx = 0; cx < chunksX; cx++) {
+            changedChunks[size_t(y / CHUNK_SIZE) * chunksX + cx] |= changedRowSpans[size_t(y) * chunksX + cx];
+        }
+    }
+    flagNeighbourhoods(changedChunks, activeChunks);
+    for (int cy = 0; cy < chunksY; cy++) {
+        for (int cx = 0; cx < chunksX; cx++) {
+            grid.chunks.setThermallyActive(cx, cy, activeChunks[size_t(cy) * chunksX + cx] != 0);
+        }
+    }
+}
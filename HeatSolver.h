@@ -0,0 +1,28 @@
+#pragma once
+
+#include "Game.h"
+
+class WorkStealingPool;
+
+// Stencil heat conduction over the awake and thermally active chunks of the grid
+// Every conducting cell exchanges heat with its conducting Moore neighbours. The exchange for a pair is
+// the one transferHeatFirstPass used to scatter from both sides, gathered here per cell instead:
+//   dT_i = sum_j 0.5 * min(k_i, k_j) * (T_j - T_i) / (c_i + c_j) * (c_j / c_i) * (1 / n_i + 1 / n_j)
+// with k the conductivity, c the specific heat capacity and n the number of neighbours inside the grid.
+// Non-conducting cells are stored as k = 0, c = 1 so they drop out of the sum without branching.
+
+// Build the per-type tables and the neighbour count plane, call after InitializeParticleTable
+void InitializeHeatSolver();
+
+// Run one conduction step, spreading rows over the pool when one is given
+// Only chunks that are awake or thermally active conduct. Cells that change by HEAT_SLEEP_THRESHOLD or more are
+// marked dirty, and their chunk and its neighbours stay thermally active for the next step. A chunk whose
+// neighbourhood stays under the threshold stops conducting until it is woken up again.
+void SolveHeat(WorkStealingPool* pool = nullptr);
+
+// Heat held by the conducting cells, the sum of c * T over them
+// Conduction between cells of the same heat capacity leaves it unchanged, Headless --check-heat compares it.
+double TotalHeat();
+
+// Temperature changes smaller than this (degrees K per tick) let a chunk fall asleep
+const double HEAT_SLEEP_THRESHOLD = 0.001;
@@ -0,0 +1,201 @@
+#include "InputLog.h"
+#include "Margolus.h"
+#include "Snapshot.h"
+
+#include <sstream>
+
+const char* INPUT_LOG_MAGIC = "fss-input";
+// Version 2 added the movement toggles, version 1 logs are the same without them so they still load
+const int INPUT_LOG_VERSION = 2;
+
+void ApplyCommand(const SimCommand& command) {
+    switch (command.type) {
+    case CommandType::PLACE:
+    case CommandType::ERASE:
+        for (int x = -command.radius; x < command.radius + 1; x++) {
+            for (int y = -command.radius; y < command.radius + 1; y++) {
+                int cellX = command.x + x;
+                int cellY = command.y + y;
+                if (!isValidIndex(cellX, cellY)) {
+                    continue;
+                }
+
+                if (command.type == CommandType::ERASE) {
+                    grid.set(cellX, cellY, Particle(ParticleType::EMPTY));
+                }
+                else if (grid.type(cellX, cellY) == ParticleType::EMPTY) {
+                    grid.set(cellX, cellY, Particle(command.particle));
+                }
+            }
+        }
+        break;
+    case CommandType::SET_WALLS:
+        setWalls(command.particle);
+        break;
+    case CommandType::CLEAR:
+        InitializeGrid();
+        ResetBlockQuietTicks();
+        break;
+    case CommandType::LOAD_SNAPSHOT:
+        LoadSnapshot(command.path);
+        break;
+    case CommandType::SET_VELOCITY_MOVEMENT:
+        velocityMovement = command.enabled;
+        break;
+    case CommandType::SET_MARGOLUS_MOVEMENT:
+        SetMovementNeighbourhood(command.enabled ? NeighborhoodType::Margolus : NeighborhoodType::Moore);
+        break;
+    }
+}
+
+// Type ids outside the particle table would index past it
+static bool parseParticleType(std::istream& in, ParticleType& type) {
+    int id;
+    if (!(in >> id) || id < 0 || id >= materialCount) {
+        return false;
+    }
+    type = ParticleType(id);
+    return true;
+}
+
+static bool parseCommand(std::istream& in, const std::string& name, SimCommand& command) {
+    if (name == "place") {
+        command.type = CommandType::PLACE;
+        return bool(in >> command.x >> command.y >> command.radius) && parseParticleType(in, command.particle);
+    }
+    if (name == "erase") {
+        command.type = CommandType::ERASE;
+        return bool(in >> command.x >> command.y >> command.radius);
+    }
+    if (name == "walls") {
+        command.type = CommandType::SET_WALLS;
+        return parseParticleType(in, command.particle);
+    }
+    if (name == "clear") {
+        command.type = CommandType::CLEAR;
+        return true;
+    }
+    if (name == "velocity") {
+        command.type = CommandType::SET_VELOCITY_MOVEMENT;
+        return bool(in >> command.enabled);
+    }
+    if (name == "margolus") {
+        command.type = CommandType::SET_MARGOLUS_MOVEMENT;
+        return bool(in >> command.enabled);
+    }
+    if (name == "load") {
+        command.type = CommandType::LOAD_SNAPSHOT;
+        in >> std::ws;
+        return bool(std::getline(in, command.path)) && !command.path.empty();
+    }
+    return false;
+}
+
+bool LoadInputLog(const std::string& path, InputLog& log) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "Failed to open input log " << path << std::endl;
+        return false;
+    }
+
+    std::string magic;
+    int version = 0;
+    std::string seedLabel, threadsLabel;
+    if (!(in >> magic >> version) || magic != INPUT_LOG_MAGIC
+        || !(in >> seedLabel >> log.seed >> threadsLabel >> log.threads) || seedLabel != "seed" || threadsLabel != "threads") {
+        std::cerr << path << " is not an input log" << std::endl;
+        return false;
+    }
+    if (version < 1 || version > INPUT_LOG_VERSION) {
+        std::cerr << "Input log " << path << " has version " << version << ", expected up to " << INPUT_LOG_VERSION << std::endl;
+        return false;
+    }
+
+    log.entries.clear();
+    bool ended = false;
+    std::string line;
+    std::getline(in, line); // Rest of the header line
+    int lineNumber = 2;
+    while (std::getline(in, line)) {
+        lineNumber++;
+        std::istringstream fields(line);
+        std::string first;
+        if (!(fields >> first)) {
+            continue;
+        }
+
+        if (first == "end") {
+            ended = bool(fields >> log.ticks);
+            break;
+        }
+
+        InputLog::Entry entry;
+        std::string name;
+        std::istringstream tick(first);
+        if (!(tick >> entry.tick) || !(fields >> name) || !parseCommand(fields, name, entry.command)
+            || (!log.entries.empty() && entry.tick < log.entries.back().tick)) {
+            std::cerr << "Input log " << path << " line " << lineNumber << " is not a valid command: " << line << std::endl;
+            return false;
+        }
+        log.entries.push_back(entry);
+    }
+
+    if (!ended) {
+        log.ticks = log.entries.empty() ? 0 : log.entries.back().tick + 1;
+        std::cerr << "Input log " << path << " has no end, replaying up to its last command (tick " << log.ticks - 1 << ")" << std::endl;
+    }
+    return true;
+}
+
+bool InputRecorder::open(const std::string& path, unsigned int seed, int threads) {
+    close();
+    ticks = 0;
+
+    out.open(path, std::ios::trunc);
+    if (!out) {
+        std::cerr << "Failed to open input log " << path << " for writing" << std::endl;
+        return false;
+    }
+    out << INPUT_LOG_MAGIC << " " << INPUT_LOG_VERSION << "\n";
+    out << "seed " << seed << " threads " << threads << std::endl;
+    return true;
+}
+
+void InputRecorder::close() {
+    if (out.is_open()) {
+        out << "end " << ticks << std::endl;
+        out.close();
+    }
+}
+
+void InputRecorder::issue(const SimCommand& command) {
+    if (out.is_open()) {
+        out << ticks << " ";
+        switch (command.type) {
+        case CommandType::PLACE:
+            out << "place " << command.x << " " << command.y << " " << command.radius << " " << int(command.particle);
+            break;
+        case CommandType::ERASE:
+            out << "erase " << command.x << " " << command.y << " " << command.radius;
+            break;
+        case CommandType::SET_WALLS:
+            out << "walls " << int(command.particle);
+            break;
+        case CommandType::CLEAR:
+            out << "clear";
+            break;
+        case CommandType::LOAD_SNAPSHOT:
+            out << "load " << command.path;
+            break;
+        case CommandType::SET_VELOCITY_MOVEMENT:
+            out << "velocity " << int(command.enabled);
+            break;
+        case CommandType::SET_MARGOLUS_MOVEMENT:
+            out << "margolus " << int(command.enabled);
+            break;
+        }
+        out << std::endl;
+    }
+
+    ApplyCommand(command);
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "Game.h"
+
+#include <fstream>
+
+// Everything the player can do to the world goes through a SimCommand, so a session can be recorded and
+// replayed. Together with the RandomDevice seed and the thread count, the commands and the ticks they were
+// issued on fully determine a run.
+
+enum class CommandType : uint8_t {
+    PLACE, // Fill the empty cells of the brush with particle
+    ERASE, // Empty every cell of the brush
+    SET_WALLS, // setWalls(particle)
+    CLEAR, // InitializeGrid
+    LOAD_SNAPSHOT, // LoadSnapshot(path)
+    SET_VELOCITY_MOVEMENT, // velocityMovement = enabled
+    SET_MARGOLUS_MOVEMENT, // SetMovementNeighbourhood(Margolus if enabled, Moore otherwise)
+};
+
+struct SimCommand {
+    CommandType type = CommandType::PLACE;
+    int x = 0, y = 0; // Brush center
+    int radius = 0; // The brush covers the square of cells within radius of its center
+    ParticleType particle = ParticleType::EMPTY;
+    std::string path; // Snapshot to load
+    bool enabled = false; // Velocity or Margolus movement on or off
+};
+
+// Apply a command to the world between two ticks
+void ApplyCommand(const SimCommand& command);
+
+// Commands in the order they were issued, each with the number of ticks run before it
+struct InputLog {
+    unsigned int seed = 0; // RandomDevice seed InitializeSimulation ran with
+    int threads = 1; // Threads of the recorded run, 1 and more than 1 take different update paths
+    uint32_t ticks = 0; // Ticks run over the whole session
+
+    struct Entry {
+        uint32_t tick;
+        SimCommand command;
+    };
+    std::vector<Entry> entries;
+};
+
+// Read a log written by InputRecorder, returns false and prints why on failure
+// A log cut short (the game never closed it) replays up to its last command.
+bool LoadInputLog(const std::string& path, InputLog& log);
+
+// Writes a session to a text log as it happens, one line per command, flushed as it goes so a crash keeps it
+// File format:
+//   fss-input 2
+//   seed <seed> threads <threads>
+//   <tick> place <x> <y> <radius> <type id>
+//   <tick> erase <x> <y> <radius>
+//   <tick> walls <type id>
+//   <tick> clear
+//   <tick> load <path>
+//   <tick> velocity <0|1>
+//   <tick> margolus <0|1>
+//   end <ticks>
+class InputRecorder {
+public:
+    ~InputRecorder() { close(); }
+
+    // Start a new log, call right after InitializeSimulation
+    bool open(const std::string& path, unsigned int seed, int threads);
+    void close();
+
+    bool isOpen() const { return out.is_open(); }
+
+    // Log a command on the current tick, then apply it
+    void issue(const SimCommand& command);
+
+    // Call after every UpdateParticles
+    void endTick() { ticks++; }
+
+private:
+    std::ofstream out;
+    uint32_t ticks = 0;
+};
@@ -0,0 +1,237 @@
+#include "Margolus.h"
+#include "ThreadPool.h"
+
+// Block rows handed to one pool task at a time
+// A block write also marks the neighbour masks of the rows just above and below it stale, which belong to the
+// next task over, so even and odd tasks run in two separate passes.
+const int BLOCK_ROWS_PER_TASK = 8;
+
+// The four cells of a block from its bottom left corner, y grows upwards
+// 0 top left, 1 top right, 2 bottom left, 3 bottom right
+const int BLOCK_DX[4] = { 0, 1, 0, 1 };
+const int BLOCK_DY[4] = { 1, 1, 0, 0 };
+
+// A rule holds the cell each of the four cells takes its particle from, 2 bits per cell
+const uint8_t IDENTITY_RULE = 0 | (1 << 2) | (2 << 4) | (3 << 6);
+
+static std::array<BlockClass, size_t(MAX_MATERIALS)> blockClassByType;
+
+// Ticks in a row each chunk has gone without a change, one per chunk
+// A block that is stable on one offset can still move on the other, so a chunk has to stay quiet for one
+// tick of each before it may sleep. Until then its rect is carried over into the next tick.
+static std::vector<uint8_t> quietTicks;
+const uint8_t QUIET_TICKS_TO_SLEEP = 2;
+
+// The first table slides particles off to the left before the right, the second to the right first
+// Every block picks one of the two at random, so piles grow evenly on both sides.
+static std::array<uint8_t, BLOCK_RULE_COUNT> blockRules[2];
+
+// Heavier cells sink through lighter ones, solids never move
+static int sinkRank(BlockClass cell) {
+    switch (cell) {
+    case BlockClass::GAS: return 0;
+    case BlockClass::EMPTY: return 1;
+    case BlockClass::FLUID: return 2;
+    case BlockClass::POWDER: return 3;
+    default: return -1;
+    }
+}
+
+static bool sinksThrough(BlockClass upper, BlockClass lower) {
+    return sinkRank(upper) >= 0 && sinkRank(lower) >= 0 && sinkRank(upper) > sinkRank(lower);
+}
+
+// Fluids and gases trade places sideways with any other cell they could move through
+static bool spreadsInto(BlockClass a, BlockClass b) {
+    return a != b && sinkRank(a) >= 0 && sinkRank(b) >= 0 && a != BlockClass::POWDER && b != BlockClass::POWDER;
+}
+
+static int ruleKey(const BlockClass (&cells)[4]) {
+    int key = 0;
+    for (int i = 3; i >= 0; i--) {
+        key = key * int(BlockClass::COUNT) + int(cells[i]);
+    }
+    return key;
+}
+
+// Every particle moves at most once: straight down first, then diagonally down, then sideways
+// A cell a particle has just left can be filled again, so a fluid can follow one falling beside it.
+static uint8_t buildRule(const BlockClass (&cells)[4], bool rightFirst) {
+    BlockClass current[4] = { cells[0], cells[1], cells[2], cells[3] };
+    int source[4] = { 0, 1, 2, 3 };
+    bool moved[4] = {};
+
+    auto trade = [&](int a, int b, bool allowed) {
+        if (!allowed || moved[a] || moved[b]) {
+            return;
+        }
+        std::swap(current[a], current[b]);
+        std::swap(source[a], source[b]);
+        moved[a] = current[a] != BlockClass::EMPTY;
+        moved[b] = current[b] != BlockClass::EMPTY;
+    };
+
+    trade(0, 2, sinksThrough(current[0], current[2]));
+    trade(1, 3, sinksThrough(current[1], current[3]));
+
+    // A gas rising diagonally is the empty cell above it sinking, so both slides are the same rule
+    int firstUpper = rightFirst ? 0 : 1;
+    int secondUpper = 1 - firstUpper;
+    trade(firstUpper, 3 - firstUpper, sinksThrough(current[firstUpper], current[3 - firstUpper]));
+    trade(secondUpper, 3 - secondUpper, sinksThrough(current[secondUpper], current[3 - secondUpper]));
+
+    trade(2, 3, spreadsInto(current[2], current[3]));
+    trade(0, 1, spreadsInto(current[0], current[1]));
+
+    return uint8_t(source[0] | (source[1] << 2) | (source[2] << 4) | (source[3] << 6));
+}
+
+void ResetBlockQuietTicks() {
+    quietTicks.assign(size_t(grid.chunks.getChunksX()) * grid.chunks.getChunksY(), 0);
+}
+
+void InitializeBlockRules() {
+    blockClassByType.fill(BlockClass::SOLID);
+    for (int i = 0; i < materialCount; i++) {
+        const generalParticleData& data = getMaterial(ParticleType(i));
+        if (data.type == ParticleType::EMPTY) {
+            blockClassByType[i] = BlockClass::EMPTY;
+        }
+        else if (data.movementDirections.empty()) {
+            blockClassByType[i] = BlockClass::SOLID;
+        }
+        else if (data.state == ParticleState::GAS || data.state == ParticleState::PLASMA) {
+            blockClassByType[i] = BlockClass::GAS;
+        }
+        else if (data.state == ParticleState::FLUID) {
+            blockClassByType[i] = BlockClass::FLUID;
+        }
+        else {
+            blockClassByType[i] = BlockClass::POWDER;
+        }
+    }
+
+    ResetBlockQuietTicks();
+
+    const int classes = int(BlockClass::COUNT);
+    for (int key = 0; key < BLOCK_RULE_COUNT; key++) {
+        BlockClass cells[4];
+        for (int i = 0, rest = key; i < 4; i++, rest /= classes) {
+            cells[i] = BlockClass(rest % classes);
+        }
+        blockRules[0][key] = buildRule(cells, false);
+        blockRules[1][key] = buildRule(cells, true);
+    }
+}
+
+// Which of the two tables a block uses, a hash of its position and the tick's salt
+// Unlike drawing from an engine this doesn't depend on the order blocks are visited in.
+static int ruleTable(int x, int y, uint64_t salt) {
+    uint64_t h = salt ^ (uint64_t(uint32_t(x)) * 0x9E3779B97F4A7C15ull) ^ (uint64_t(uint32_t(y)) * 0xC2B2AE3D27D4EB4Full);
+    h = (h ^ (h >> 31)) * 0xBF58476D1CE4E5B9ull;
+    return int((h >> 47) & 1);
+}
+
+// Rewrite the blocks with their bottom row at y, returns the particles in the blocks visited
+static int updateBlockRow(int y, int offset, uint64_t salt) {
+    int width = grid.getWidth();
+    int chunksX = grid.chunks.getChunksX();
+    int cy0 = y / CHUNK_SIZE;
+    int cy1 = (y + 1) / CHUNK_SIZE;
+
+    int particles = 0;
+    for (int cx = 0; cx < chunksX; cx++) {
+        // Blocks starting in this chunk column, with an offset the last one reaches into the next column
+        bool awake = false;
+        for (int c = cx; c <= std::min(cx + offset, chunksX - 1); c++) {
+            awake = awake || grid.chunks.isAwake(c, cy0) || grid.chunks.isAwake(c, cy1);
+        }
+        if (!awake) {
+            continue;
+        }
+
+        int endX = std::min((cx + 1) * CHUNK_SIZE + offset, width - 1);
+        for (int x = cx * CHUNK_SIZE + offset; x < endX; x += 2) {
+            BlockClass cells[4];
+            int occupied = 0;
+            for (int i = 0; i < 4; i++) {
+                cells[i] = blockClassByType[size_t(grid.type(x + BLOCK_DX[i], y + BLOCK_DY[i]))];
+                occupied += cells[i] != BlockClass::EMPTY;
+            }
+            if (occupied == 0) {
+                continue;
+            }
+            particles += occupied;
+
+            uint8_t rule = blockRules[ruleTable(x, y, salt)][ruleKey(cells)];
+            if (rule == IDENTITY_RULE) {
+                continue;
+            }
+
+            Particle block[4];
+            for (int i = 0; i < 4; i++) {
+                block[i] = grid.get(x + BLOCK_DX[i], y + BLOCK_DY[i]);
+            }
+            for (int i = 0; i < 4; i++) {
+                int from = (rule >> (2 * i)) & 3;
+                if (from != i) {
+                    grid.set(x + BLOCK_DX[i], y + BLOCK_DY[i], block[from]);
+                }
+            }
+        }
+    }
+    return particles;
+}
+
+int UpdateBlocks(WorkStealingPool* pool) {
+    // Blocks start on even cells one tick and odd cells the next, cells in the last row or column without a partner sit out
+    int offset = int(simulationTick % 2);
+    int blockRows = (grid.getHeight() - offset) / 2;
+    int tasks = (blockRows + BLOCK_ROWS_PER_TASK - 1) / BLOCK_ROWS_PER_TASK;
+    uint64_t salt = SimRandom::engine()();
+
+    std::atomic<int> particles{ 0 };
+    auto runTask = [&](int task) {
+        int count = 0;
+        for (int row = task * BLOCK_ROWS_PER_TASK; row < std::min((task + 1) * BLOCK_ROWS_PER_TASK, blockRows); row++) {
+            count += updateBlockRow(offset + 2 * row, offset, salt);
+        }
+        particles.fetch_add(count, std::memory_order_relaxed);
+    };
+
+    grid.setConcurrentWrites(pool != nullptr);
+    if (pool) {
+        for (int parity = 0; parity < 2; parity++) {
+            pool->parallelFor((tasks + 1 - parity) / 2, [&](int i) { runTask(2 * i + parity); });
+        }
+    }
+    else {
+        for (int task = 0; task < tasks; task++) {
+            runTask(task);
+        }
+    }
+    grid.setConcurrentWrites(false);
+
+    for (int cy = 0; cy < grid.chunks.getChunksY(); cy++) {
+        for (int cx = 0; cx < grid.chunks.getChunksX(); cx++) {
+            uint8_t& quiet = quietTicks[size_t(cy) * grid.chunks.getChunksX() + cx];
+            DirtyRect pending = grid.chunks.getPendingRect(cx, cy);
+            if (!pending.empty()) {
+                quiet = 0;
+                continue;
+            }
+            if (!grid.chunks.isAwake(cx, cy)) {
+                // Whatever wakes it up again, it gets a tick of each offset before it may sleep
+                quiet = 0;
+                continue;
+            }
+
+            quiet++;
+            if (quiet < QUIET_TICKS_TO_SLEEP) {
+                grid.chunks.setPendingRect(cx, cy, grid.chunks.getDirtyRect(cx, cy));
+            }
+        }
+    }
+
+    return particles.load();
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "Game.h"
+
+class WorkStealingPool;
+
+// Block cellular automaton movement, what UpdateParticles runs with NeighborhoodType::Margolus
+// The grid is split into 2x2 blocks, shifted one cell diagonally every other tick, and every block is rewritten
+// in one step by a rule looked up from the classes of its four cells. Blocks never share a cell, so they can be
+// rewritten in any order with the same result. Writes do reach the cached neighbour masks one row past a
+// block though, so threads only ever work on block rows at least a task apart.
+//
+// Only the class of a material counts: heavier classes sink through lighter ones (powder, fluid, empty, gas
+// from heaviest to lightest), powders and fluids slide off diagonally, fluids and gases spread sideways and
+// fixed materials never move. Densities within a class, dispersion, velocity, reactions, emissions, cloning
+// and phase transitions are left out. Heat still conducts and lifetimes still run out.
+
+// Classes in the order their values make up a rule key
+enum class BlockClass : uint8_t {
+    EMPTY,
+    GAS, // Gases and plasma
+    FLUID,
+    POWDER, // Powders and solids that move
+    SOLID, // Materials that never move
+    COUNT
+};
+
+// One rule for every combination of the four cells of a block
+const int BLOCK_RULE_COUNT = int(BlockClass::COUNT) * int(BlockClass::COUNT) * int(BlockClass::COUNT) * int(BlockClass::COUNT);
+
+// Classify the particle table and build the rules, call after InitializeParticleTable and whenever the grid is resized
+void InitializeBlockRules();
+
+// Forget how long every chunk has been quiet, call whenever the grid is replaced by another world
+void ResetBlockQuietTicks();
+
+// Rewrite every block that touches an awake chunk once, spreading block rows over the pool when one is given
+// Returns the number of particles in the blocks visited.
+int UpdateBlocks(WorkStealingPool* pool = nullptr);
@@ -0,0 +1,597 @@
+#include "Materials.h"
+
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <sstream>
+
+// Materials the code refers to by name, the file has to list them first and in ParticleType order
+static const char* const BUILTIN_MATERIAL_NAMES[] = {
+    "EMPTY", "SAND", "WATER", "METHANE", "FIRE", "SMOKE", "STEAM", "STONE", "DUST", "LAVA",
+    "CLONE", "ICE", "PLASMA", "WALL", "DIAMOND", "MERCURY", "OIL", "ERASER", "WOOD", "BURNING_WOOD",
+};
+static_assert(sizeof(BUILTIN_MATERIAL_NAMES) / sizeof(BUILTIN_MATERIAL_NAMES[0]) == size_t(ParticleType::COUNT),
+    "Every ParticleType needs its name in the materials file");
+
+// Cache layout: MaterialCacheHeader, then the materials, reactions and emissions of the set as raw records
+
+const char MATERIAL_CACHE_MAGIC[8] = { 'F', 'S', 'S', 'M', 'A', 'T', '\r', '\n' };
+
+struct MaterialCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t materialCount;
+    uint32_t reactionCount;
+    uint32_t emissionCount;
+    uint64_t sourceSize; // Of the text file the cache was compiled from
+    int64_t sourceTime; // Its last write time, in ticks of the file clock
+};
+
+static_assert(sizeof(MaterialCacheHeader) == 40, "Material cache header must not contain padding");
+
+static MaterialSet loadedSet;
+
+const MaterialSet& getMaterialSet() {
+    return loadedSet;
+}
+
+// A plain number, or a fraction like 1/300
+static bool parseNumber(const std::string& text, double& value) {
+    auto parsePlain = [](const std::string& part, double& result) {
+        char* end = nullptr;
+        result = std::strtod(part.c_str(), &end);
+        return !part.empty() && end == part.c_str() + part.size() && std::isfinite(result);
+    };
+
+    size_t slash = text.find('/');
+    if (slash == std::string::npos) {
+        return parsePlain(text, value);
+    }
+    double numerator, denominator;
+    if (!parsePlain(text.substr(0, slash), numerator) || !parsePlain(text.substr(slash + 1), denominator) || denominator == 0.0) {
+        return false;
+    }
+    value = numerator / denominator;
+    return true;
+}
+
+// Kelvin, or celsius with a C suffix
+static bool parseTemperature(std::string text, double& kelvin) {
+    bool celsius = !text.empty() && text.back() == 'C';
+    if (celsius) {
+        text.pop_back();
+    }
+    double value;
+    if (!parseNumber(text, value)) {
+        return false;
+    }
+    // Summed in float like every other CELSIUS_TO_KELVIN conversion in the game
+    kelvin = celsius ? double(float(value) + CELSIUS_TO_KELVIN) : value;
+    return kelvin >= 0.0;
+}
+
+static bool namedColor(const std::string& name, glm::vec4& color) {
+    const std::pair<const char*, glm::vec4> colors[] = {
+        { "BLACK", BLACK }, { "WHITE", WHITE }, { "YELLOW", YELLOW }, { "RED", RED }, { "GRAY", GRAY },
+        { "BLUE", BLUE }, { "GREEN", GREEN }, { "SKYBLUE", SKYBLUE }, { "PURPLE", PURPLE }, { "GOLD", GOLD },
+    };
+    for (const auto& named : colors) {
+        if (name == named.first) {
+            color = named.second;
+            return true;
+        }
+    }
+    return false;
+}
+
+// NAME, rgb(r, g, b) or mix(a, b, t), read from text at pos with the spaces already taken out
+static bool parseColor(const std::string& text, size_t& pos, glm::vec4& color) {
+    size_t start = pos;
+    while (pos < text.size() && (std::isalnum((unsigned char)text[pos]) || text[pos] == '_')) {
+        pos++;
+    }
+    std::string word = text.substr(start, pos - start);
+    if (pos >= text.size() || text[pos] != '(') {
+        return namedColor(word, color);
+    }
+    pos++;
+
+    // Number up to the next separator, which is consumed as well
+    auto argument = [&](char separator, double& value) {
+        size_t end = text.find(separator, pos);
+        if (end == std::string::npos || !parseNumber(text.substr(pos, end - pos), value)) {
+            return false;
+        }
+        pos = end + 1;
+        return true;
+    };
+
+    if (word == "rgb") {
+        double r, g, b;
+        if (!argument(',', r) || !argument(',', g) || !argument(')', b)) {
+            return false;
+        }
+        color = glm::vec4(float(r / 255.0), float(g / 255.0), float(b / 255.0), 1.0f);
+        return r >= 0 && r <= 255 && g >= 0 && g <= 255 && b >= 0 && b <= 255;
+    }
+    if (word == "mix") {
+        glm::vec4 a, b;
+        double t;
+        if (!parseColor(text, pos, a) || pos >= text.size() || text[pos++] != ','
+            || !parseColor(text, pos, b) || pos >= text.size() || text[pos++] != ',' || !argument(')', t)) {
+            return false;
+        }
+        color = glm::mix(a, b, float(t));
+        return true;
+    }
+    return false;
+}
+
+// Reads the whole file, reporting every problem rather than stopping at the first
+class MaterialParser {
+public:
+    MaterialParser(const std::string& path) : path(path) {}
+
+    bool parse(MaterialSet& set);
+
+private:
+    struct Block {
+        MaterialRecord record = {};
+        std::vector<ReactionRecord> reactions;
+        std::vector<EmissionRecord> emissions;
+        std::set<std::string> seen; // Keys that may only appear once
+        bool hasState = false;
+        bool fixed = false;
+        int dispersion = -1; // -1 until given
+        int line = 0;
+    };
+
+    void error(const std::string& message) {
+        std::cerr << path << ":" << line << ": " << message << std::endl;
+        errors++;
+    }
+
+    bool findType(const std::string& name, uint8_t& type);
+    void parseLine(std::istringstream& in, const std::string& key, Block& block);
+
+    std::string path;
+    int line = 0;
+    int errors = 0;
+    std::vector<std::string> names;
+};
+
+bool MaterialParser::findType(const std::string& name, uint8_t& type) {
+    for (size_t i = 0; i < names.size(); i++) {
+        if (names[i] == name) {
+            type = uint8_t(i);
+            return true;
+        }
+    }
+    error("unknown material " + name);
+    return false;
+}
+
+bool MaterialParser::parse(MaterialSet& set) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "Failed to open materials file " << path << std::endl;
+        return false;
+    }
+
+    std::vector<std::string> lines;
+    for (std::string text; std::getline(in, text);) {
+        size_t comment = text.find('#');
+        if (comment != std::string::npos) {
+            text.erase(comment);
+        }
+        lines.push_back(text);
+    }
+
+    // Names first, so materials can refer to ones further down
+    std::vector<Block> blocks;
+    for (line = 1; line <= int(lines.size()); line++) {
+        std::istringstream words(lines[line - 1]);
+        std::string key, name, extra;
+        if (!(words >> key) || key != "material") {
+            continue;
+        }
+        if (!(words >> name) || words >> extra) {
+            error("expected material NAME");
+            continue;
+        }
+        if (name.size() >= size_t(MATERIAL_NAME_SIZE)) {
+            error("material name " + name + " is longer than " + std::to_string(MATERIAL_NAME_SIZE - 1) + " characters");
+            continue;
+        }
+        if (std::find(names.begin(), names.end(), name) != names.end()) {
+            error("material " + name + " is defined twice");
+            continue;
+        }
+        names.push_back(name);
+        blocks.emplace_back();
+        blocks.back().line = line;
+        std::strncpy(blocks.back().record.name, name.c_str(), MATERIAL_NAME_SIZE - 1);
+    }
+
+    line = 0;
+    if (names.size() > size_t(MAX_MATERIALS)) {
+        error(std::to_string(names.size()) + " materials, at most " + std::to_string(MAX_MATERIALS) + " fit");
+    }
+    for (int i = 0; i < int(ParticleType::COUNT); i++) {
+        if (i >= int(names.size()) || names[i] != BUILTIN_MATERIAL_NAMES[i]) {
+            error("material " + std::to_string(i) + " has to be " + BUILTIN_MATERIAL_NAMES[i]);
+        }
+    }
+    if (errors > 0) {
+        return false;
+    }
+
+    for (Block& block : blocks) {
+        MaterialRecord& record = block.record;
+        record.temperature = double(30 + CELSIUS_TO_KELVIN);
+        record.thermalConductivity = 1;
+        record.specificHeatCapacity = 1;
+        record.lowerTransitionPoint = -1;
+        record.upperTransitionPoint = 9999999.9;
+        record.halflife = -1;
+        record.state = uint8_t(ParticleState::EMPTY);
+    }
+
+    Block* block = nullptr;
+    for (line = 1; line <= int(lines.size()); line++) {
+        std::istringstream words(lines[line - 1]);
+        std::string key;
+        if (!(words >> key)) {
+            continue;
+        }
+        if (key == "material") {
+            block = nullptr;
+            for (Block& candidate : blocks) {
+                if (candidate.line == line) {
+                    block = &candidate;
+                }
+            }
+            continue;
+        }
+        if (block == nullptr) {
+            error(key + " outside of a material");
+            continue;
+        }
+        parseLine(words, key, *block);
+    }
+
+    line = 0;
+    for (Block& block : blocks) {
+        if (!block.hasState) {
+            line = block.line;
+            error(std::string("material ") + block.record.name + " has no state");
+        }
+        else if (block.dispersion >= 0 && ParticleState(block.record.state) != ParticleState::FLUID) {
+            line = block.line;
+            error(std::string("material ") + block.record.name + " has a dispersion but isn't a FLUID");
+        }
+    }
+    if (errors > 0) {
+        return false;
+    }
+
+    set = MaterialSet();
+    for (Block& block : blocks) {
+        MaterialRecord& record = block.record;
+        record.moves = uint8_t(!block.fixed && ParticleState(record.state) != ParticleState::EMPTY);
+        if (ParticleState(record.state) == ParticleState::FLUID) {
+            record.dispersion = uint8_t(block.dispersion >= 0 ? block.dispersion : DEFAULT_FLUID_DISPERSION);
+        }
+        record.firstReaction = uint32_t(set.reactions.size());
+        record.reactionCount = uint32_t(block.reactions.size());
+        record.firstEmission = uint32_t(set.emissions.size());
+        record.emissionCount = uint32_t(block.emissions.size());
+        set.materials.push_back(record);
+        set.reactions.insert(set.reactions.end(), block.reactions.begin(), block.reactions.end());
+        set.emissions.insert(set.emissions.end(), block.emissions.begin(), block.emissions.end());
+    }
+    return true;
+}
+
+void MaterialParser::parseLine(std::istringstream& in, const std::string& key, Block& block) {
+    MaterialRecord& record = block.record;
+    std::vector<std::string> words;
+    for (std::string word; in >> word;) {
+        words.push_back(word);
+    }
+
+    // Chances are per tick
+    auto rate = [&](const std::string& text, double& value) {
+        if (!parseNumber(text, value) || value <= 0.0 || value > 1.0) {
+            error("expected a chance between 0 and 1, got " + text);
+            return false;
+        }
+        return true;
+    };
+    auto number = [&](const std::string& text, double& value) {
+        if (!parseNumber(text, value) || value < 0.0) {
+            error("expected a number of at least 0, got " + text);
+            return false;
+        }
+        return true;
+    };
+    auto temperature = [&](const std::string& text, double& value) {
+        if (!parseTemperature(text, value)) {
+            error("expected a temperature above absolute zero, got " + text);
+            return false;
+        }
+        return true;
+    };
+    auto expectWords = [&](size_t count) {
+        if (words.size() != count) {
+            error(key + " takes " + std::to_string(count) + (count == 1 ? " value" : " values"));
+            return false;
+        }
+        return true;
+    };
+
+    bool once = key != "react" && key != "emit";
+    if (once && !block.seen.insert(key).second) {
+        error(key + " is given twice");
+        return;
+    }
+
+    if (key == "color") {
+        std::string text;
+        for (const std::string& word : words) {
+            text += word;
+        }
+        glm::vec4 color;
+        size_t pos = 0;
+        if (!parseColor(text, pos, color) || pos != text.size()) {
+            error("can't read color " + text);
+            return;
+        }
+        std::memcpy(record.color, &color.x, sizeof(record.color));
+    }
+    else if (key == "density") {
+        if (expectWords(1)) {
+            number(words[0], record.density);
+        }
+    }
+    else if (key == "conductivity") {
+        if (expectWords(1)) {
+            number(words[0], record.thermalConductivity);
+        }
+    }
+    else if (key == "heat_capacity") {
+        if (expectWords(1)) {
+            number(words[0], record.specificHeatCapacity);
+        }
+    }
+    else if (key == "temperature") {
+        if (expectWords(1)) {
+            temperature(words[0], record.temperature);
+        }
+    }
+    else if (key == "state") {
+        const char* states[] = { "EMPTY", "SOLID", "POWDER", "FLUID", "GAS", "PLASMA" };
+        if (!expectWords(1)) {
+            return;
+        }
+        for (int i = 0; i < int(sizeof(states) / sizeof(states[0])); i++) {
+            if (words[0] == states[i]) {
+                record.state = uint8_t(i);
+                block.hasState = true;
+            }
+        }
+        if (!block.hasState) {
+            error("unknown state " + words[0]);
+        }
+    }
+    else if (key == "fixed") {
+        block.fixed = expectWords(0);
+    }
+    else if (key == "dispersion") {
+        double value;
+        if (expectWords(1) && number(words[0], value)) {
+            if (value != std::floor(value) || value > MAX_MATERIAL_DISPERSION) {
+                error("dispersion has to be a whole number of cells up to " + std::to_string(MAX_MATERIAL_DISPERSION));
+                return;
+            }
+            block.dispersion = int(value);
+        }
+    }
+    else if (key == "below" || key == "above") {
+        if (!expectWords(2)) {
+            return;
+        }
+        bool below = key == "below";
+        temperature(words[0], below ? record.lowerTransitionPoint : record.upperTransitionPoint);
+        findType(words[1], below ? record.lowerTransitionType : record.upperTransitionType);
+    }
+    else if (key == "halflife") {
+        if (expectWords(2)) {
+            rate(words[0], record.halflife);
+            findType(words[1], record.endOfLifeType);
+        }
+    }
+    else if (key == "emit") {
+        EmissionRecord emission = {};
+        if (expectWords(2) && rate(words[0], emission.halflife) && findType(words[1], emission.type)) {
+            block.emissions.push_back(emission);
+        }
+    }
+    else if (key == "react") {
+        // react R A[+B...] -> TYPE [T]
+        if (words.size() < 4 || words.size() > 5 || words[2] != "->") {
+            error("expected react R A[+B...] -> TYPE [T]");
+            return;
+        }
+        ReactionRecord reaction = {};
+        reaction.resultTemperature = -1;
+        bool valid = rate(words[0], reaction.halflife);
+        std::istringstream prerequisites(words[1]);
+        for (std::string name; std::getline(prerequisites, name, '+');) {
+            uint8_t type = 0;
+            if (findType(name, type)) {
+                reaction.prerequisiteMask |= typeBit(ParticleType(type));
+            }
+            else {
+                valid = false;
+            }
+        }
+        valid = findType(words[3], reaction.resultType) && valid;
+        if (words.size() == 5) {
+            valid = temperature(words[4], reaction.resultTemperature) && valid;
+        }
+        if (!valid) {
+            return;
+        }
+
+        // Single prerequisites share one cell of the interaction matrix per neighbour type
+        bool single = (reaction.prerequisiteMask & (reaction.prerequisiteMask - 1)) == 0;
+        for (const ReactionRecord& other : block.reactions) {
+            if (single && other.prerequisiteMask == reaction.prerequisiteMask) {
+                error("there already is a reaction with " + words[1] + " alone");
+                return;
+            }
+        }
+        if (block.reactions.size() >= MAX_MATERIAL_REACTIONS) {
+            error("more than " + std::to_string(MAX_MATERIAL_REACTIONS) + " reactions");
+            return;
+        }
+        block.reactions.push_back(reaction);
+    }
+    else {
+        error("unknown property " + key);
+    }
+}
+
+bool CompileMaterials(const std::string& path, MaterialSet& set) {
+    MaterialParser parser(path);
+    return parser.parse(set);
+}
+
+// What the cache has to match to be used, the text's size and when it was last written
+static bool sourceStamp(const std::string& path, uint64_t& size, int64_t& time) {
+    std::error_code error;
+    size = uint64_t(std::filesystem::file_size(path, error));
+    if (error) {
+        return false;
+    }
+    time = int64_t(std::filesystem::last_write_time(path, error).time_since_epoch().count());
+    return !error;
+}
+
+template<typename Record>
+static bool readRecords(std::ifstream& in, std::vector<Record>& records, uint32_t count) {
+    records.resize(count);
+    return bool(in.read(reinterpret_cast<char*>(records.data()), std::streamsize(count * sizeof(Record))));
+}
+
+static bool readCache(const std::string& path, uint64_t sourceSize, int64_t sourceTime, MaterialSet& set) {
+    std::ifstream in(path, std::ios::binary);
+    MaterialCacheHeader header;
+    if (!in || !in.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+        return false;
+    }
+    if (std::memcmp(header.magic, MATERIAL_CACHE_MAGIC, sizeof(header.magic)) != 0 || header.version != MATERIAL_CACHE_VERSION
+        || header.sourceSize != sourceSize || header.sourceTime != sourceTime
+        || header.materialCount < uint32_t(ParticleType::COUNT) || header.materialCount > uint32_t(MAX_MATERIALS)
+        || header.reactionCount > header.materialCount * MAX_MATERIAL_REACTIONS) {
+        return false;
+    }
+
+    // The counts size the allocations below, so they have to account for the whole file before anything is read
+    std::error_code error;
+    uint64_t fileSize = uint64_t(std::filesystem::file_size(path, error));
+    uint64_t expectedSize = sizeof(MaterialCacheHeader) + uint64_t(header.materialCount) * sizeof(MaterialRecord)
+        + uint64_t(header.reactionCount) * sizeof(ReactionRecord) + uint64_t(header.emissionCount) * sizeof(EmissionRecord);
+    if (error || fileSize != expectedSize) {
+        return false;
+    }
+
+    if (!readRecords(in, set.materials, header.materialCount) || !readRecords(in, set.reactions, header.reactionCount)
+        || !readRecords(in, set.emissions, header.emissionCount)) {
+        return false;
+    }
+
+    // Nothing in a damaged cache may index past the tables
+    uint32_t typeCount = header.materialCount;
+    for (const MaterialRecord& record : set.materials) {
+        if (record.lowerTransitionType >= typeCount || record.upperTransitionType >= typeCount || record.endOfLifeType >= typeCount
+            || record.state > uint8_t(ParticleState::PLASMA) || record.name[MATERIAL_NAME_SIZE - 1] != '\0'
+            || record.dispersion > MAX_MATERIAL_DISPERSION
+            || record.reactionCount > MAX_MATERIAL_REACTIONS || uint64_t(record.firstReaction) + record.reactionCount > set.reactions.size()
+            || uint64_t(record.firstEmission) + record.emissionCount > set.emissions.size()) {
+            return false;
+        }
+    }
+    for (const ReactionRecord& reaction : set.reactions) {
+        if (reaction.resultType >= typeCount || reaction.prerequisiteMask == 0 || reaction.prerequisiteMask >> typeCount != 0) {
+            return false;
+        }
+    }
+    for (const EmissionRecord& emission : set.emissions) {
+        if (emission.type >= typeCount) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool writeCache(const std::string& path, uint64_t sourceSize, int64_t sourceTime, const MaterialSet& set) {
+    MaterialCacheHeader header = {};
+    std::memcpy(header.magic, MATERIAL_CACHE_MAGIC, sizeof(header.magic));
+    header.version = MATERIAL_CACHE_VERSION;
+    header.materialCount = uint32_t(set.materials.size());
+    header.reactionCount = uint32_t(set.reactions.size());
+    header.emissionCount = uint32_t(set.emissions.size());
+    header.sourceSize = sourceSize;
+    header.sourceTime = sourceTime;
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(set.materials.data()), std::streamsize(set.materials.size() * sizeof(MaterialRecord)));
+    out.write(reinterpret_cast<const char*>(set.reactions.data()), std::streamsize(set.reactions.size() * sizeof(ReactionRecord)));
+    out.write(reinterpret_cast<const char*>(set.emissions.data()), std::streamsize(set.emissions.size() * sizeof(EmissionRecord)));
+    return bool(out);
+}
+
+bool LoadMaterials(const std::string& path) {
+    uint64_t sourceSize;
+    int64_t sourceTime;
+    if (!sourceStamp(path, sourceSize, sourceTime)) {
+        std::cerr << "Failed to open materials file " << path << std::endl;
+        return false;
+    }
+
+    std::string cachePath = path + ".cache";
+    MaterialSet set;
+    if (!readCache(cachePath, sourceSize, sourceTime, set)) {
+        if (!CompileMaterials(path, set)) {
+            return false;
+        }
+        // A cache that can't be written only costs the next startup a parse
+        if (!writeCache(cachePath, sourceSize, sourceTime, set)) {
+            std::cerr << "Failed to write materials cache " << cachePath << std::endl;
+        }
+    }
+
+    loadedSet = std::move(set);
+    return true;
+}
+
+uint64_t HashMaterialSet(const MaterialSet& set) {
+    uint64_t hash = 14695981039346656037ull;
+    auto add = [&hash](const void* data, size_t size) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; i++) {
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        }
+    };
+    // The records are padding free and built zeroed, so their raw bytes only differ where the definitions do
+    add(set.materials.data(), set.materials.size() * sizeof(MaterialRecord));
+    add(set.reactions.data(), set.reactions.size() * sizeof(ReactionRecord));
+    add(set.emissions.data(), set.emissions.size() * sizeof(EmissionRecord));
+    return hash;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "Game.h"
+
+// Material definitions, read from a text file at startup (see resources/materials.txt for the format)
+// The text is checked and compiled into the flat records below, which InitializeParticleTable turns into
+// the particle table. The compiled records are also written next to the text as a cache, and later
+// startups read that instead as long as the text hasn't changed since.
+
+const char* const DEFAULT_MATERIALS_PATH = "resources/materials.txt";
+
+// Longest material name, including the terminating zero
+const int MATERIAL_NAME_SIZE = 32;
+
+// Most reactions one material can have, AlchemicReaction::order has to hold them
+const size_t MAX_MATERIAL_REACTIONS = 255;
+
+// Cells a fluid looks along a row past its first step when it spreads, unless the file says otherwise
+const int DEFAULT_FLUID_DISPERSION = 8;
+
+// Keeps maxUpdateReach under half a chunk, so the parallel update still applies
+const int MAX_MATERIAL_DISPERSION = CHUNK_SIZE / 2 - 2;
+
+// Chances and half-lives vary by this much from run to run, rolled by InitializeParticleTable
+const double MATERIAL_RATE_JITTER = 0.1;
+
+// One material, before the per-run rolls
+struct MaterialRecord {
+    char name[MATERIAL_NAME_SIZE];
+    float color[4];
+    double density;
+    double temperature;
+    double thermalConductivity;
+    double specificHeatCapacity;
+    double lowerTransitionPoint; // -1 for none
+    double upperTransitionPoint; // 9999999.9 for none
+    double halflife; // -1 for none
+    uint8_t lowerTransitionType;
+    uint8_t upperTransitionType;
+    uint8_t endOfLifeType;
+    uint8_t state; // ParticleState
+    uint8_t moves; // 0 for fixed materials, which get no movement directions
+    uint8_t dispersion; // Fluids only, 0 for everything else
+    uint8_t reserved[2];
+    uint32_t firstReaction; // Into MaterialSet::reactions
+    uint32_t reactionCount;
+    uint32_t firstEmission; // Into MaterialSet::emissions
+    uint32_t emissionCount;
+};
+
+struct ReactionRecord {
+    double halflife;
+    double resultTemperature; // -1 keeps the temperature
+    uint32_t prerequisiteMask; // typeBit of every prerequisite
+    uint8_t resultType;
+    uint8_t reserved[3];
+};
+
+struct EmissionRecord {
+    double halflife;
+    uint8_t type;
+    uint8_t reserved[7];
+};
+
+static_assert(sizeof(MaterialRecord) == 128, "Material records are cached as raw bytes and must not contain padding");
+static_assert(sizeof(ReactionRecord) == 24, "Reaction records are cached as raw bytes and must not contain padding");
+static_assert(sizeof(EmissionRecord) == 16, "Emission records are cached as raw bytes and must not contain padding");
+
+// Every material in id order, each one's reactions and emissions a contiguous run of the shared lists
+struct MaterialSet {
+    std::vector<MaterialRecord> materials;
+    std::vector<ReactionRecord> reactions;
+    std::vector<EmissionRecord> emissions;
+};
+
+// Bumped whenever the records or the cache layout change, caches of another version are recompiled
+const uint32_t MATERIAL_CACHE_VERSION = 2;
+
+// Load the materials in the text file at path, from its cache when that is up to date
+// Call before InitializeSimulation. Returns false and prints every problem found on failure, with the line it's on.
+bool LoadMaterials(const std::string& path);
+
+// Parse and check the text file at path without touching the cache, returns false and prints why on failure
+bool CompileMaterials(const std::string& path, MaterialSet& set);
+
+// The set LoadMaterials loaded, empty before that
+const MaterialSet& getMaterialSet();
+
+// FNV-1a over every record of set, equal for sets that define the same materials
+uint64_t HashMaterialSet(const MaterialSet& set);
@@ -0,0 +1,222 @@
+#include "Profiler.h"
+
+#ifdef SIM_PROFILING
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+namespace Profiler {
+    // Threads past this share the last slot, their counts still add up but their trace events share a row
+    const int MAX_PROFILED_THREADS = 64;
+
+    const char* const SCOPE_NAMES[] = { "heat", "pre_actions", "movement", "post_actions", "render", "draw" };
+    const char* const COUNTER_NAMES[] = { "moves", "density_swaps", "erased", "reactions", "phase_transitions", "emissions" };
+    static_assert(sizeof(SCOPE_NAMES) / sizeof(SCOPE_NAMES[0]) == size_t(Scope::COUNT), "Every scope needs a name");
+    static_assert(sizeof(COUNTER_NAMES) / sizeof(COUNTER_NAMES[0]) == size_t(Counter::COUNT), "Every counter needs a name");
+
+    // One per thread and on its own cache line, so counting never contends
+    struct alignas(64) ThreadSlot {
+        std::array<std::atomic<uint64_t>, size_t(Counter::COUNT)> counters{};
+        std::atomic<const char*> name{ nullptr };
+    };
+
+    struct TraceEvent {
+        int64_t start; // Nanoseconds since reset
+        int64_t duration;
+        Scope scope;
+        int thread;
+    };
+
+    struct TickRow {
+        uint32_t tick;
+        int64_t end; // Nanoseconds since reset
+        std::array<int64_t, size_t(Scope::COUNT)> scopeNanoseconds;
+        std::array<uint64_t, size_t(Counter::COUNT)> counts;
+    };
+
+    static ThreadSlot slots[MAX_PROFILED_THREADS];
+    static std::atomic<int> slotsTaken{ 0 };
+
+    static std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+    static std::array<std::atomic<int64_t>, size_t(Scope::COUNT)> scopeTotals{};
+    static std::array<uint64_t, size_t(Counter::COUNT)> countedBefore{}; // Counter sums at the last endTick
+
+    static std::mutex recordMutex;
+    static std::vector<TraceEvent> events;
+    static std::vector<TickRow> rows;
+    static std::atomic<uint64_t> droppedRecords{ 0 };
+
+    static int threadSlot() {
+        thread_local int slot = std::min(slotsTaken.fetch_add(1, std::memory_order_relaxed), MAX_PROFILED_THREADS - 1);
+        return slot;
+    }
+
+    static int64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+    }
+
+    void reset(size_t tickCapacity, size_t eventCapacity) {
+        std::lock_guard<std::mutex> lock(recordMutex);
+        epoch = std::chrono::steady_clock::now();
+        for (ThreadSlot& slot : slots) {
+            for (std::atomic<uint64_t>& counter : slot.counters) {
+                counter.store(0, std::memory_order_relaxed);
+            }
+        }
+        for (std::atomic<int64_t>& total : scopeTotals) {
+            total.store(0, std::memory_order_relaxed);
+        }
+        countedBefore.fill(0);
+
+        events.clear();
+        events.reserve(eventCapacity);
+        rows.clear();
+        rows.reserve(tickCapacity);
+        droppedRecords.store(0);
+    }
+
+    void nameThread(const char* name) {
+        slots[threadSlot()].name.store(name, std::memory_order_relaxed);
+    }
+
+    void count(Counter counter, uint64_t amount) {
+        slots[threadSlot()].counters[size_t(counter)].fetch_add(amount, std::memory_order_relaxed);
+    }
+
+    void endTick(uint32_t tick) {
+        TickRow row;
+        row.tick = tick;
+        row.end = now();
+        for (size_t s = 0; s < row.scopeNanoseconds.size(); s++) {
+            row.scopeNanoseconds[s] = scopeTotals[s].exchange(0, std::memory_order_relaxed);
+        }
+
+        int threads = std::min(slotsTaken.load(std::memory_order_relaxed), MAX_PROFILED_THREADS);
+        for (size_t c = 0; c < row.counts.size(); c++) {
+            uint64_t sum = 0;
+            for (int t = 0; t < threads; t++) {
+                sum += slots[t].counters[c].load(std::memory_order_relaxed);
+            }
+            row.counts[c] = sum - countedBefore[c];
+            countedBefore[c] = sum;
+        }
+
+        std::lock_guard<std::mutex> lock(recordMutex);
+        if (rows.size() < rows.capacity()) {
+            rows.push_back(row);
+        }
+        else {
+            droppedRecords.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    uint64_t getDroppedRecords() {
+        return droppedRecords.load();
+    }
+
+    ScopedTimer::ScopedTimer(Scope scope) : scope(scope), start(now()) {}
+
+    ScopedTimer::~ScopedTimer() {
+        int64_t duration = now() - start;
+        scopeTotals[size_t(scope)].fetch_add(duration, std::memory_order_relaxed);
+
+        std::lock_guard<std::mutex> lock(recordMutex);
+        if (events.size() < events.capacity()) {
+            events.push_back({ start, duration, scope, threadSlot() });
+        }
+        else {
+            droppedRecords.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    bool writeCsv(const std::string& path) {
+        std::ofstream out(path);
+        if (!out) {
+            std::cerr << "Failed to create profile " << path << std::endl;
+            return false;
+        }
+        out << std::fixed << std::setprecision(4);
+
+        out << "tick";
+        for (const char* name : SCOPE_NAMES) {
+            out << "," << name << "_ms";
+        }
+        for (const char* name : COUNTER_NAMES) {
+            out << "," << name;
+        }
+        out << "\n";
+
+        for (const TickRow& row : rows) {
+            out << row.tick;
+            for (int64_t nanoseconds : row.scopeNanoseconds) {
+                out << "," << double(nanoseconds) / 1.0e6;
+            }
+            for (uint64_t count : row.counts) {
+                out << "," << count;
+            }
+            out << "\n";
+        }
+
+        if (!out) {
+            std::cerr << "Failed to write profile " << path << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    bool writeTrace(const std::string& path) {
+        std::ofstream out(path);
+        if (!out) {
+            std::cerr << "Failed to create trace " << path << std::endl;
+            return false;
+        }
+
+        // Timestamps are microseconds, with the nanoseconds kept as decimals
+        out << std::fixed << std::setprecision(3);
+        auto microseconds = [](int64_t nanoseconds) { return double(nanoseconds) / 1000.0; };
+
+        out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        bool first = true;
+        auto separator = [&]() -> std::ofstream& {
+            out << (first ? "" : ",\n");
+            first = false;
+            return out;
+        };
+
+        int threads = std::min(slotsTaken.load(), MAX_PROFILED_THREADS);
+        for (int t = 0; t < threads; t++) {
+            const char* name = slots[t].name.load();
+            separator() << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << t
+                << ",\"args\":{\"name\":\"" << (name != nullptr ? name : "thread") << " " << t << "\"}}";
+        }
+
+        for (const TraceEvent& event : events) {
+            separator() << "{\"name\":\"" << SCOPE_NAMES[size_t(event.scope)] << "\",\"cat\":\"sim\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread
+                << ",\"ts\":" << microseconds(event.start) << ",\"dur\":" << microseconds(event.duration) << "}";
+        }
+
+        // Counters as counter tracks, one sample per tick
+        for (const TickRow& row : rows) {
+            separator() << "{\"name\":\"counters\",\"ph\":\"C\",\"pid\":1,\"ts\":" << microseconds(row.end) << ",\"args\":{";
+            for (size_t c = 0; c < row.counts.size(); c++) {
+                out << (c > 0 ? "," : "") << "\"" << COUNTER_NAMES[c] << "\":" << row.counts[c];
+            }
+            out << "}}";
+        }
+        out << "\n]}\n";
+
+        if (!out) {
+            std::cerr << "Failed to write trace " << path << std::endl;
+            return false;
+        }
+        return true;
+    }
+}
+
+#endif
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Built-in profiler: scoped timers and event counters, exported as CSV or as a Chrome trace
+// Everything is compiled out unless SIM_PROFILING is defined, the PROFILE_ macros below then expand to
+// nothing and none of the functions exist. With it defined every timed scope becomes a trace event and
+// adds to its total, counters add up per thread and every finished tick samples both into one CSV row.
+//
+// Recording never allocates: reset reserves room for a number of ticks and trace events up front, anything
+// past that is dropped and counted.
+
+namespace Profiler {
+    enum class Scope {
+        HEAT,
+        PRE_ACTIONS,
+        MOVEMENT,
+        POST_ACTIONS,
+        RENDER, // RenderParticles, in the game
+        DRAW, // DrawFramebuffer, in the game
+        COUNT
+    };
+
+    enum class Counter {
+        MOVES, // Particles moved into an empty cell
+        DENSITY_SWAPS,
+        ERASED, // Particles deleted by moving into ERASER
+        REACTIONS,
+        PHASE_TRANSITIONS,
+        EMISSIONS,
+        COUNT
+    };
+
+#ifdef SIM_PROFILING
+    // Drop everything recorded so far and make room for tickCapacity CSV rows and eventCapacity trace events
+    // Call while nothing is being profiled.
+    void reset(size_t tickCapacity, size_t eventCapacity);
+
+    // Label the calling thread in the trace, name has to outlive the profiler
+    void nameThread(const char* name);
+
+    void count(Counter counter, uint64_t amount = 1);
+
+    // Sample the time spent in every scope and the counts since the last call as the row of tick
+    void endTick(uint32_t tick);
+
+    // One row per tick: milliseconds spent in every scope and every counter over that tick
+    // Scopes on other threads (drawing in the game) land in the row of the tick that ends next.
+    // Both return false and print why on failure. Call while nothing is being profiled.
+    bool writeCsv(const std::string& path);
+
+    // Chrome trace_event JSON, open it in chrome://tracing or ui.perfetto.dev
+    bool writeTrace(const std::string& path);
+
+    // Ticks and trace events that didn't fit what reset reserved
+    uint64_t getDroppedRecords();
+
+    class ScopedTimer {
+    public:
+        explicit ScopedTimer(Scope scope);
+        ~ScopedTimer();
+
+        ScopedTimer(const ScopedTimer&) = delete;
+        ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+    private:
+        Scope scope;
+        int64_t start; // Nanoseconds since reset
+    };
+#endif
+}
+
+#ifdef SIM_PROFILING
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(scope) Profiler::ScopedTimer PROFILE_CONCAT(profileScope, __LINE__)(Profiler::Scope::scope)
+#define PROFILE_COUNT(counter) Profiler::count(Profiler::Counter::counter)
+#define PROFILE_END_TICK(tick) Profiler::endTick(tick)
+#define PROFILE_THREAD(name) Profiler::nameThread(name)
+#else
+#define PROFILE_SCOPE(scope) ((void)0)
+#define PROFILE_COUNT(counter) ((void)0)
+#define PROFILE_END_TICK(tick) ((void)0)
+#define PROFILE_THREAD(name) ((void)0)
+#endif
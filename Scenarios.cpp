@@ -0,0 +1,113 @@
+#include "Scenarios.h"
+
+void fillRect(int x0, int y0, int x1, int y1, ParticleType type) {
+    for (int y = std::max(y0, 0); y <= std::min(y1, grid.getHeight() - 1); y++) {
+        for (int x = std::max(x0, 0); x <= std::min(x1, grid.getWidth() - 1); x++) {
+            grid.set(x, y, Particle(type));
+        }
+    }
+}
+
+// y = 0 is the bottom of the world, gravity pulls towards it
+
+static void buildEmpty() {
+    setWalls(ParticleType::WALL);
+}
+
+static void buildSandPile() {
+    setWalls(ParticleType::WALL);
+    fillRect(grid.getWidth() / 2 - 30, grid.getHeight() / 2, grid.getWidth() / 2 + 30, grid.getHeight() - 10, ParticleType::SAND);
+}
+
+static void buildWaterTank() {
+    setWalls(ParticleType::WALL);
+    fillRect(10, grid.getHeight() / 2, grid.getWidth() / 3, grid.getHeight() - 10, ParticleType::WATER);
+}
+
+static void buildLavaLake() {
+    setWalls(ParticleType::WALL);
+    fillRect(1, 1, grid.getWidth() - 2, 30, ParticleType::LAVA);
+    fillRect(grid.getWidth() / 4, 60, grid.getWidth() * 3 / 4, 100, ParticleType::WATER);
+}
+
+static void buildBurningForest() {
+    setWalls(ParticleType::WALL);
+    fillRect(1, 1, grid.getWidth() - 2, 10, ParticleType::STONE);
+    for (int x = 10; x < grid.getWidth() - 10; x += 12) {
+        fillRect(x, 11, x + 2, 60, ParticleType::WOOD);
+    }
+    fillRect(10, 61, 12, 63, ParticleType::FIRE);
+}
+
+// A cloud of methane drifting up into a fire lit underneath it
+static void buildMethaneFire() {
+    setWalls(ParticleType::WALL);
+    fillRect(1, 1, grid.getWidth() - 2, 5, ParticleType::STONE);
+    fillRect(20, 30, grid.getWidth() - 21, grid.getHeight() - 30, ParticleType::METHANE);
+    fillRect(grid.getWidth() / 2 - 2, 6, grid.getWidth() / 2 + 2, 10, ParticleType::FIRE);
+}
+
+// A heap of sand on a stone shelf, spilling over its edge
+static void buildSandAvalanche() {
+    setWalls(ParticleType::WALL);
+    fillRect(1, grid.getHeight() / 2 - 4, grid.getWidth() / 2, grid.getHeight() / 2, ParticleType::STONE);
+    fillRect(1, grid.getHeight() / 2 + 1, grid.getWidth() / 2, grid.getHeight() - 10, ParticleType::SAND);
+}
+
+// CLONE blocks along the ceiling pouring water, oil and sand onto an ERASER floor that drains them
+static void buildCloneFlood() {
+    setWalls(ParticleType::WALL);
+    fillRect(1, 1, grid.getWidth() - 2, 1, ParticleType::ERASER);
+    const ParticleType sources[] = { ParticleType::WATER, ParticleType::OIL, ParticleType::SAND };
+    int spacing = grid.getWidth() / 4;
+    for (int i = 0; i < 3; i++) {
+        int x = spacing * (i + 1);
+        fillRect(x - 4, grid.getHeight() - 6, x + 4, grid.getHeight() - 4, ParticleType::CLONE);
+        fillRect(x - 4, grid.getHeight() - 7, x + 4, grid.getHeight() - 7, sources[i]);
+    }
+}
+
+// Oil, water and mercury stacked upside down, sinking through each other into density order
+static void buildDensityStack() {
+    setWalls(ParticleType::WALL);
+    int layer = (grid.getHeight() - 20) / 3;
+    fillRect(1, 1, grid.getWidth() - 2, layer, ParticleType::OIL);
+    fillRect(1, layer + 1, grid.getWidth() - 2, 2 * layer, ParticleType::WATER);
+    fillRect(1, 2 * layer + 1, grid.getWidth() - 2, 3 * layer, ParticleType::MERCURY);
+}
+
+// A settled sand bed with its left third warmer than the rest, nothing moves and the heat only spreads
+static void buildHeatBed() {
+    setWalls(ParticleType::WALL);
+    fillRect(1, 1, grid.getWidth() - 2, 12, ParticleType::SAND);
+    for (int y = 1; y <= 12; y++) {
+        for (int x = 1; x < grid.getWidth() / 3; x++) {
+            grid.temperature(x, y) += 20.0;
+        }
+    }
+}
+
+const std::vector<Scenario>& getScenarios() {
+    static const std::vector<Scenario> scenarios = {
+        { "empty", "Walls only", &buildEmpty },
+        { "sand_pile", "A block of sand collapsing into a pile", &buildSandPile },
+        { "water_tank", "A column of water levelling out", &buildWaterTank },
+        { "lava_lake", "A lava lake boiling a body of water", &buildLavaLake },
+        { "burning_forest", "Wood trunks catching fire from one end", &buildBurningForest },
+        { "methane_fire", "A methane cloud catching fire from below", &buildMethaneFire },
+        { "sand_avalanche", "A heap of sand sliding off a shelf", &buildSandAvalanche },
+        { "clone_flood", "CLONE sources flooding a drained box with water, oil and sand", &buildCloneFlood },
+        { "density_stack", "Mercury, water and oil settling into layers", &buildDensityStack },
+        { "heat_bed", "Heat spreading through a sand bed warmer on one side", &buildHeatBed },
+    };
+    return scenarios;
+}
+
+const Scenario* findScenario(const std::string& name) {
+    for (const Scenario& scenario : getScenarios()) {
+        if (scenario.name == name) {
+            return &scenario;
+        }
+    }
+    return nullptr;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "Game.h"
+
+// A named starting state used by the headless runner
+struct Scenario {
+    std::string name;
+    std::string description;
+    void (*build)(); // Fills the (already cleared) grid
+};
+
+const std::vector<Scenario>& getScenarios();
+
+// Returns nullptr if no scenario has that name
+const Scenario* findScenario(const std::string& name);
+
+// Fill every cell in the inclusive rectangle with new particles of the given type
+void fillRect(int x0, int y0, int x1, int y1, ParticleType type);
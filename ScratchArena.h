@@ -0,0 +1,88 @@
+#pragma once
+
+#include "FixedVector.h"
+
+#include <algorithm>
+#include <memory>
+#include <type_traits>
+
+// Per-thread bump allocator for temporary arrays in the update loop
+// Memory handed out stays valid until the Frame that was open when it was allocated closes.
+// Blocks are kept once allocated, so after the first few ticks the arena never touches the heap.
+class ScratchArena {
+public:
+    // Arena of the calling thread
+    static ScratchArena& local() {
+        thread_local ScratchArena arena;
+        return arena;
+    }
+
+    // Everything allocated while a Frame is open is released when it closes, frames nest
+    class Frame {
+    public:
+        Frame() : arena(local()), block(arena.currentBlock), used(arena.used) {}
+        ~Frame() {
+            arena.currentBlock = block;
+            arena.used = used;
+        }
+
+        Frame(const Frame&) = delete;
+        Frame& operator=(const Frame&) = delete;
+
+    private:
+        ScratchArena& arena;
+        size_t block;
+        size_t used;
+    };
+
+    // Uninitialised room for count values of T
+    template<typename T>
+    Span<T> allocate(size_t count) {
+        static_assert(std::is_trivially_destructible<T>::value, "Scratch memory is released without running destructors");
+        return Span<T>(static_cast<T*>(allocateBytes(count * sizeof(T), alignof(T))), count);
+    }
+
+    // Copy of values that can be reordered freely
+    template<typename T>
+    Span<T> copy(Span<const T> values) {
+        Span<T> result = allocate<T>(values.size());
+        std::copy(values.begin(), values.end(), result.begin());
+        return result;
+    }
+
+private:
+    static constexpr size_t BLOCK_SIZE = 64 * 1024;
+
+    // The first block is taken up front, so a thread only touches the heap when it first uses its arena
+    ScratchArena() {
+        blocks.push_back({ std::unique_ptr<unsigned char[]>(new unsigned char[BLOCK_SIZE]), BLOCK_SIZE });
+    }
+
+    struct Block {
+        std::unique_ptr<unsigned char[]> bytes;
+        size_t size;
+    };
+
+    void* allocateBytes(size_t bytes, size_t alignment) {
+        while (true) {
+            if (currentBlock < blocks.size()) {
+                Block& block = blocks[currentBlock];
+                size_t start = (used + alignment - 1) / alignment * alignment;
+                if (start + bytes <= block.size) {
+                    used = start + bytes;
+                    return block.bytes.get() + start;
+                }
+                currentBlock++;
+                used = 0;
+                continue;
+            }
+
+            size_t size = std::max(BLOCK_SIZE, bytes + alignment);
+            blocks.push_back({ std::unique_ptr<unsigned char[]>(new unsigned char[size]), size });
+        }
+    }
+
+    std::vector<Block> blocks;
+    size_t currentBlock = 0;
+    size_t used = 0;
+};
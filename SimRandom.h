@@ -0,0 +1,168 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Random numbers for the simulation hot paths
+// The engine used is per thread: the shared simulation engine by default, or the engine of the chunk
+// a worker is currently updating, so parallel updates never touch shared generator state.
+namespace SimRandom {
+    // xoshiro256** by Blackman and Vigna, a few shifts and rotates per 64 bit draw
+    // Every stream is the previous one advanced by 2^128 draws with jump(), so streams never overlap.
+    class Engine {
+    public:
+        using result_type = uint64_t;
+
+        explicit Engine(uint64_t seedValue = 0) {
+            seed(seedValue);
+        }
+
+        // Expand a 64 bit seed into the 256 bit state with splitmix64
+        void seed(uint64_t seedValue) {
+            for (uint64_t& word : state) {
+                seedValue += 0x9E3779B97F4A7C15ull;
+                uint64_t z = seedValue;
+                z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+                z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+                word = z ^ (z >> 31);
+            }
+        }
+
+        // Raw generator state, snapshots save and restore it so a loaded world draws the same numbers
+        std::array<uint64_t, 4> getState() const {
+            return { state[0], state[1], state[2], state[3] };
+        }
+
+        void setState(const std::array<uint64_t, 4>& newState) {
+            for (int i = 0; i < 4; i++) {
+                state[i] = newState[i];
+            }
+        }
+
+        static constexpr result_type min() { return 0; }
+        static constexpr result_type max() { return UINT64_MAX; }
+
+        result_type operator()() {
+            uint64_t result = rotl(state[1] * 5, 7) * 9;
+            uint64_t t = state[1] << 17;
+
+            state[2] ^= state[0];
+            state[3] ^= state[1];
+            state[1] ^= state[2];
+            state[0] ^= state[3];
+            state[2] ^= t;
+            state[3] = rotl(state[3], 45);
+
+            return result;
+        }
+
+        // Advance by 2^128 draws
+        void jump() {
+            static const uint64_t JUMP[] = { 0x180EC6D33CFD0ABAull, 0xD5A61266F0C9392Cull, 0xA9582618E03FC9AAull, 0x39ABDC4529B1661Cull };
+
+            uint64_t jumped[4] = { 0, 0, 0, 0 };
+            for (uint64_t word : JUMP) {
+                for (int bit = 0; bit < 64; bit++) {
+                    if (word & (uint64_t(1) << bit)) {
+                        for (int i = 0; i < 4; i++) {
+                            jumped[i] ^= state[i];
+                        }
+                    }
+                    (*this)();
+                }
+            }
+            for (int i = 0; i < 4; i++) {
+                state[i] = jumped[i];
+            }
+        }
+
+    private:
+        static uint64_t rotl(uint64_t x, int k) {
+            return (x << k) | (x >> (64 - k));
+        }
+
+        uint64_t state[4];
+    };
+
+    inline Engine& sharedEngine() {
+        static Engine engine;
+        return engine;
+    }
+
+    inline Engine*& currentEngine() {
+        thread_local Engine* engine = nullptr;
+        return engine;
+    }
+
+    inline Engine& engine() {
+        Engine* current = currentEngine();
+        return current != nullptr ? *current : sharedEngine();
+    }
+
+    // Route this thread's draws to the given engine, nullptr goes back to the shared one
+    inline void setEngine(Engine* engine) {
+        currentEngine() = engine;
+    }
+
+    inline void reseed(uint64_t seed) {
+        sharedEngine().seed(seed);
+    }
+
+    // Fill streams with consecutive non-overlapping streams split off the shared engine
+    inline void splitStreams(std::vector<Engine>& streams) {
+        Engine stream = sharedEngine();
+        for (Engine& engine : streams) {
+            stream.jump();
+            engine = stream;
+        }
+    }
+
+    // Uniform value in [0, 1) from the top bits of one draw
+    template<typename T>
+    inline T unit();
+
+    template<>
+    inline float unit<float>() {
+        return float(engine()() >> 40) * 0x1.0p-24f;
+    }
+
+    template<>
+    inline double unit<double>() {
+        return double(engine()() >> 11) * 0x1.0p-53;
+    }
+
+    // Uniform value in [min, max)
+    template<typename T>
+    inline T range(T min, T max) {
+        return min + unit<T>() * (max - min);
+    }
+
+    // Uniform index in [0, count), multiply-shift instead of a modulo
+    inline int index(int count) {
+        return int((uint64_t(uint32_t(engine()() >> 32)) * uint64_t(count)) >> 32);
+    }
+
+    // value scaled by a random factor in [1 - variance, 1 + variance]
+    inline double roughly(double value, double variance) {
+        return value * range(1.0 - variance, 1.0 + variance);
+    }
+
+    // Fill out with count uniform values in [0, 1)
+    template<typename T>
+    inline void fill(T* out, size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            out[i] = unit<T>();
+        }
+    }
+
+    // Fisher-Yates shuffle drawing from the current engine
+    template<typename It>
+    inline void shuffle(It first, It last) {
+        for (int i = int(last - first) - 1; i > 0; i--) {
+            std::swap(first[i], first[index(i + 1)]);
+        }
+    }
+}
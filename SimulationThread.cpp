@@ -0,0 +1,172 @@
+#include "SimulationThread.h"
+#include "Profiler.h"
+#include "Snapshot.h"
+
+#include <chrono>
+#include <cstring>
+
+SimulationThread::SimulationThread(InputRecorder& recorder, const TickSchedule& schedule)
+    : recorder(recorder), schedule(schedule), framebuffer(grid), rowVersions(size_t(grid.getHeight()), 0),
+      timestep(std::max(schedule.substeps, 1) / schedule.ticksPerSecond, schedule.maxCatchUpSteps) {
+    this->schedule.substeps = std::max(schedule.substeps, 1);
+}
+
+void SimulationThread::start() {
+    if (thread.joinable()) {
+        return;
+    }
+    stopping.store(false);
+    publish(); // The first frame is out before start returns
+    thread = std::thread(&SimulationThread::run, this);
+}
+
+void SimulationThread::stop() {
+    if (thread.joinable()) {
+        stopping.store(true);
+        thread.join();
+    }
+}
+
+void SimulationThread::issue(const SimCommand& command) {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    queued.push_back(command);
+}
+
+void SimulationThread::requestSave(const std::string& path) {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    savePath = path;
+}
+
+void SimulationThread::stepOnce() {
+    paused.store(true);
+    stepRequested.store(true);
+}
+
+void SimulationThread::setHoveredCell(int x, int y) {
+    hoveredCell.store((uint64_t(uint32_t(x)) << 32) | uint32_t(y));
+}
+
+const SimFrame& SimulationThread::acquireFrame() {
+    if (newest.load(std::memory_order_relaxed) & NEWEST_FRESH) {
+        front = newest.exchange(front, std::memory_order_acq_rel) & ~NEWEST_FRESH;
+    }
+    return slots[front];
+}
+
+void SimulationThread::run() {
+    using Clock = std::chrono::steady_clock;
+    PROFILE_THREAD("simulation");
+
+    Clock::time_point last = Clock::now();
+    Clock::time_point rateStart = last;
+    while (!stopping.load()) {
+        applyQueued();
+
+        Clock::time_point now = Clock::now();
+        double elapsed = std::chrono::duration<double>(now - last).count();
+        last = now;
+
+        // Paused time isn't owed afterwards, F still runs single ticks
+        bool step = stepRequested.exchange(false);
+        if (paused.load()) {
+            timestep.reset();
+            if (step) {
+                runTicks(1);
+            }
+        }
+        else {
+            for (int steps = timestep.advance(elapsed); steps > 0 && !stopping.load(); steps--) {
+                runTicks(schedule.substeps);
+            }
+        }
+
+        // Ticks per second over roughly the last half second
+        double rateElapsed = std::chrono::duration<double>(Clock::now() - rateStart).count();
+        if (rateElapsed >= 0.5) {
+            ticksPerSecond = rateTicks / rateElapsed;
+            rateTicks = 0;
+            rateStart = Clock::now();
+        }
+
+        // Once per wake up, so catching up publishes only where it got to, and input and the hovered cell
+        // still show up while paused
+        publish();
+
+        std::this_thread::sleep_for(std::chrono::duration<double>(timestep.secondsUntilNextStep()));
+    }
+}
+
+void SimulationThread::runTicks(int count) {
+    for (int i = 0; i < count; i++) {
+        UpdateParticles();
+        recorder.endTick();
+    }
+    rateTicks += count;
+}
+
+// Commands go through the recorder so they're logged on the tick they're applied
+void SimulationThread::applyQueued() {
+    std::string save;
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        applying.swap(queued);
+        save.swap(savePath);
+    }
+
+    for (const SimCommand& command : applying) {
+        recorder.issue(command);
+    }
+    applying.clear();
+
+    if (!save.empty()) {
+        SaveSnapshot(save);
+    }
+}
+
+void SimulationThread::publish() {
+    int width = grid.getWidth();
+    int height = grid.getHeight();
+    if (framebuffer.getWidth() != width || framebuffer.getHeight() != height) {
+        framebuffer = CellFramebuffer(grid); // Its first refresh copies every row
+        rowVersions.assign(size_t(height), 0);
+    }
+
+    CellFramebuffer::RowRange changed = framebuffer.refresh(grid);
+    version++;
+    for (int y = changed.first; y < changed.last; y++) {
+        rowVersions[y] = version;
+    }
+
+    // The back slot last held an older frame, bring over the rows that changed since then
+    SimFrame& frame = slots[back];
+    if (frame.width != width || frame.height != height) {
+        frame.width = width;
+        frame.height = height;
+        frame.pixels.assign(size_t(width) * height, 0);
+        frame.version = 0;
+    }
+    for (int y = 0; y < height; y++) {
+        if (rowVersions[y] > frame.version) {
+            size_t row = size_t(y) * width;
+            std::memcpy(&frame.pixels[row], framebuffer.getPixels() + row, size_t(width) * sizeof(uint32_t));
+        }
+    }
+    frame.rowVersions = rowVersions;
+    frame.version = version;
+
+    frame.tick = simulationTick;
+    frame.ticksPerSecond = ticksPerSecond;
+    frame.droppedTicks = timestep.getDroppedSteps() * uint64_t(schedule.substeps);
+    frame.particleCount = framebuffer.getParticleCount();
+    frame.awakeChunks = grid.chunks.countAwake();
+
+    uint64_t cell = hoveredCell.load();
+    int x = int(uint32_t(cell >> 32));
+    int y = int(uint32_t(cell));
+    frame.hoveredValid = isValidIndex(x, y);
+    if (frame.hoveredValid) {
+        frame.hovered = grid.get(x, y);
+    }
+
+    back = newest.exchange(back | NEWEST_FRESH, std::memory_order_acq_rel) & ~NEWEST_FRESH;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "FixedTimestep.h"
+#include "Framebuffer.h"
+#include "InputLog.h"
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+// Everything the renderer reads about one published simulation state
+struct SimFrame {
+    int width = 0; // Size of the grid, which can change when a snapshot of another size is loaded
+    int height = 0;
+    std::vector<uint32_t> pixels; // Same layout as CellFramebuffer
+    std::vector<uint64_t> rowVersions; // Version each row last changed on, upload rows newer than what's on screen
+    uint64_t version = 0; // Counts publishes, 0 until the first one
+
+    uint32_t tick = 0; // simulationTick
+    double ticksPerSecond = 0.0;
+    uint64_t droppedTicks = 0; // Ticks skipped because the simulation couldn't keep up
+    int particleCount = 0;
+    int awakeChunks = 0;
+
+    // The cell under the cursor, see SimulationThread::setHoveredCell
+    bool hoveredValid = false;
+    Particle hovered;
+};
+
+// How fast the simulation runs, independent of the frame rate
+struct TickSchedule {
+    double ticksPerSecond = 300.0;
+    int substeps = 1; // Ticks run back to back per step, a frame is published after every step
+    int maxCatchUpSteps = 4; // Most steps run at once to make up for lost time, the rest is dropped
+};
+
+// Runs UpdateParticles on its own thread so a slow tick doesn't hold up drawing and the other way around
+// Ticks are paced by a TickSchedule. After each batch of ticks the thread copies the changed rows into one
+// of three SimFrames and swaps it in as the newest. The renderer swaps the newest one out whenever it wants a frame, neither side ever waits on the
+// other. Player input is queued and applied on the simulation thread between ticks, through the recorder,
+// so the grid is only ever touched from that one thread while it runs.
+class SimulationThread {
+public:
+    // recorder logs and applies every command
+    SimulationThread(InputRecorder& recorder, const TickSchedule& schedule);
+    ~SimulationThread() { stop(); }
+
+    SimulationThread(const SimulationThread&) = delete;
+    SimulationThread& operator=(const SimulationThread&) = delete;
+
+    // Call after the world is set up, the grid belongs to the simulation thread until stop
+    void start();
+    void stop();
+
+    // Queue a command, applied in order before the next tick
+    void issue(const SimCommand& command);
+
+    // Save a snapshot to path before the next tick
+    void requestSave(const std::string& path);
+
+    void setPaused(bool value) { paused.store(value); }
+    bool isPaused() const { return paused.load(); }
+
+    // Pause and run exactly one more tick
+    void stepOnce();
+
+    // Cell the next frames report in SimFrame::hovered
+    void setHoveredCell(int x, int y);
+
+    // The newest published frame, or the one from the last call if nothing newer is out yet
+    // Only one thread may acquire frames, the reference stays valid until its next call.
+    const SimFrame& acquireFrame();
+
+private:
+    void run();
+    void applyQueued();
+    void runTicks(int count);
+    void publish();
+
+    InputRecorder& recorder;
+    TickSchedule schedule;
+
+    std::thread thread;
+    std::atomic<bool> stopping{ false };
+    std::atomic<bool> paused{ false };
+    std::atomic<bool> stepRequested{ false };
+    std::atomic<uint64_t> hoveredCell{ 0 }; // x in the high half, y in the low half
+
+    // Queued input, swapped out whole by the simulation thread
+    std::mutex queueMutex;
+    std::vector<SimCommand> queued;
+    std::vector<SimCommand> applying;
+    std::string savePath;
+
+    // Only touched by the simulation thread, rebuilt when the grid changes size
+    CellFramebuffer framebuffer;
+    std::vector<uint64_t> rowVersions;
+    FixedTimestep timestep;
+    uint64_t version = 0;
+    int rateTicks = 0;
+    double ticksPerSecond = 0.0;
+
+    // Triple buffer: the simulation writes slots[back], the renderer reads slots[front] and the third is the
+    // newest finished frame, its index in `newest` with NEWEST_FRESH set until the renderer takes it
+    static const int NEWEST_FRESH = 4;
+    SimFrame slots[3];
+    int back = 2;
+    int front = 0;
+    std::atomic<int> newest{ 1 };
+};
@@ -0,0 +1,460 @@
+#include "Snapshot.h"
+#include "Margolus.h"
+
+#include <cstring>
+#include <fstream>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// File layout: SnapshotHeader, the rolled material rates, one engine state per chunk, one SnapshotChunk per chunk,
+// then the chunk data
+// Chunks are stored row by row (y, then x), the cells inside a chunk row-major from its bottom left cell.
+
+const char SNAPSHOT_MAGIC[8] = { 'F', 'S', 'S', 'N', 'A', 'P', '\r', '\n' };
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t chunkSize;
+    uint32_t typeCount; // materialCount when saved, type ids are only meaningful for the same list
+    uint32_t planeCount;
+    uint32_t simulationTick;
+    uint32_t chunkEngineCount;
+    uint32_t rateCount;
+    uint32_t reserved;
+    uint64_t sharedEngine[4];
+};
+
+struct SnapshotChunk {
+    uint64_t offset; // From the start of the file
+    uint64_t size;
+    int32_t pendingMinX, pendingMinY, pendingMaxX, pendingMaxY; // DirtyRect for the next tick
+    uint32_t thermallyActive;
+    uint32_t reserved;
+};
+
+static_assert(sizeof(SnapshotHeader) == 80, "Snapshot header must not contain padding");
+static_assert(sizeof(SnapshotChunk) == 40, "Snapshot chunk entry must not contain padding");
+
+// InitializeParticleTable rolls every half-life and reaction/emission chance with getRoughly, so the table
+// differs from seed to seed and has to be saved along with the world
+template<typename Visit>
+static void forEachRolledRate(Visit visit) {
+    for (int i = 0; i < materialCount; i++) {
+        generalParticleData& data = particleTable[i];
+        visit(data.halflife);
+        for (uint32_t r = 0; r < data.reactionCount; r++) {
+            visit(getReaction(ParticleType(i), r).halflife);
+        }
+        for (uint32_t e = 0; e < data.emissionCount; e++) {
+            visit(materialEmissions[data.firstEmission + e].halflife);
+        }
+    }
+}
+
+static uint32_t countRolledRates() {
+    uint32_t count = 0;
+    forEachRolledRate([&](double&) { count++; });
+    return count;
+}
+
+template<typename T>
+static void append(std::vector<unsigned char>& out, const T& value) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&value);
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+// PackBits over whole values of size bytes: a control byte n < 128 is followed by n + 1 literal values,
+// n >= 128 by a single value that repeats n - 126 times (2 to 129)
+static void encodeRuns(const unsigned char* values, size_t count, size_t size, std::vector<unsigned char>& out) {
+    auto same = [&](size_t a, size_t b) { return std::memcmp(values + a * size, values + b * size, size) == 0; };
+
+    size_t i = 0;
+    while (i < count) {
+        size_t run = 1;
+        while (i + run < count && run < 129 && same(i, i + run)) {
+            run++;
+        }
+
+        if (run >= 2) {
+            out.push_back(uint8_t(run + 126));
+            out.insert(out.end(), values + i * size, values + (i + 1) * size);
+            i += run;
+            continue;
+        }
+
+        // Literals last until the next pair of equal values
+        size_t start = i;
+        while (i < count && i - start < 128 && !(i + 1 < count && same(i, i + 1))) {
+            i++;
+        }
+        out.push_back(uint8_t(i - start - 1));
+        out.insert(out.end(), values + start * size, values + i * size);
+    }
+}
+
+// Inverse of encodeRuns, fails instead of reading or writing past either buffer
+static bool decodeRuns(const unsigned char*& in, const unsigned char* end, unsigned char* values, size_t count, size_t size) {
+    size_t i = 0;
+    while (i < count) {
+        if (in == end) {
+            return false;
+        }
+
+        uint8_t control = *in++;
+        if (control < 128) {
+            size_t literals = size_t(control) + 1;
+            if (i + literals > count || size_t(end - in) < literals * size) {
+                return false;
+            }
+            std::memcpy(values + i * size, in, literals * size);
+            in += literals * size;
+            i += literals;
+        }
+        else {
+            size_t repeats = size_t(control) - 126;
+            if (i + repeats > count || size_t(end - in) < size) {
+                return false;
+            }
+            for (size_t j = 0; j < repeats; j++) {
+                std::memcpy(values + (i + j) * size, in, size);
+            }
+            in += size;
+            i += repeats;
+        }
+    }
+    return true;
+}
+
+void EncodeCells(int x0, int y0, int x1, int y1, std::vector<unsigned char>& out, std::vector<unsigned char>& scratch) {
+    size_t cells = size_t(x1 - x0) * size_t(y1 - y0);
+
+    // Gather the rows into one buffer so runs carry on from one row into the next
+    for (const Grid::RawPlane& plane : grid.storedPlanes()) {
+        size_t rowBytes = size_t(x1 - x0) * plane.elementSize;
+        scratch.resize(cells * plane.elementSize);
+        for (int y = y0; y < y1; y++) {
+            std::memcpy(scratch.data() + size_t(y - y0) * rowBytes, plane.bytes + grid.index(x0, y) * plane.elementSize, rowBytes);
+        }
+        encodeRuns(scratch.data(), cells, plane.elementSize, out);
+    }
+}
+
+bool DecodeCells(const unsigned char* bytes, size_t size, int x0, int y0, int x1, int y1, std::vector<unsigned char>& scratch) {
+    const unsigned char* in = bytes;
+    const unsigned char* end = bytes + size;
+    size_t cells = size_t(x1 - x0) * size_t(y1 - y0);
+
+    for (const Grid::RawPlane& plane : grid.storedPlanes()) {
+        scratch.resize(cells * plane.elementSize);
+        if (!decodeRuns(in, end, scratch.data(), cells, plane.elementSize)) {
+            return false;
+        }
+
+        size_t rowBytes = size_t(x1 - x0) * plane.elementSize;
+        for (int y = y0; y < y1; y++) {
+            std::memcpy(plane.bytes + grid.index(x0, y) * plane.elementSize, scratch.data() + size_t(y - y0) * rowBytes, rowBytes);
+        }
+    }
+    return true;
+}
+
+// Cell range of chunk (cx, cy), clipped to a width x height grid
+struct ChunkBounds {
+    int x0, y0, x1, y1; // Exclusive x1, y1
+
+    ChunkBounds(int cx, int cy, int width = grid.getWidth(), int height = grid.getHeight())
+        : x0(cx * CHUNK_SIZE), y0(cy * CHUNK_SIZE),
+          x1(std::min((cx + 1) * CHUNK_SIZE, width)), y1(std::min((cy + 1) * CHUNK_SIZE, height)) {}
+};
+
+bool SaveSnapshot(const std::string& path) {
+    int chunksX = grid.chunks.getChunksX();
+    int chunksY = grid.chunks.getChunksY();
+    size_t chunkCount = size_t(chunksX) * chunksY;
+    const std::vector<SimRandom::Engine>& chunkEngines = getChunkEngines();
+
+    SnapshotHeader header = {};
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.width = uint32_t(grid.getWidth());
+    header.height = uint32_t(grid.getHeight());
+    header.chunkSize = CHUNK_SIZE;
+    header.typeCount = uint32_t(materialCount);
+    header.planeCount = uint32_t(Grid::STORED_PLANE_COUNT);
+    header.simulationTick = simulationTick;
+    header.chunkEngineCount = uint32_t(chunkEngines.size());
+    header.rateCount = countRolledRates();
+    std::array<uint64_t, 4> sharedState = SimRandom::sharedEngine().getState();
+    std::copy(sharedState.begin(), sharedState.end(), header.sharedEngine);
+
+    std::vector<unsigned char> file;
+    append(file, header);
+    forEachRolledRate([&](double& rate) { append(file, rate); });
+    for (const SimRandom::Engine& engine : chunkEngines) {
+        for (uint64_t word : engine.getState()) {
+            append(file, word);
+        }
+    }
+
+    size_t tableOffset = file.size();
+    file.resize(file.size() + chunkCount * sizeof(SnapshotChunk));
+
+    std::vector<unsigned char> gathered;
+    for (int cy = 0; cy < chunksY; cy++) {
+        for (int cx = 0; cx < chunksX; cx++) {
+            ChunkBounds bounds(cx, cy);
+            const DirtyRect& pending = grid.chunks.getPendingRect(cx, cy);
+
+            SnapshotChunk entry;
+            entry.offset = file.size();
+            entry.pendingMinX = pending.minX;
+            entry.pendingMinY = pending.minY;
+            entry.pendingMaxX = pending.maxX;
+            entry.pendingMaxY = pending.maxY;
+            entry.thermallyActive = grid.chunks.isThermallyActive(cx, cy);
+            entry.reserved = 0;
+            EncodeCells(bounds.x0, bounds.y0, bounds.x1, bounds.y1, file, gathered);
+
+            entry.size = file.size() - entry.offset;
+            std::memcpy(file.data() + tableOffset + (size_t(cy) * chunksX + cx) * sizeof(SnapshotChunk), &entry, sizeof(entry));
+        }
+    }
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out.write(reinterpret_cast<const char*>(file.data()), std::streamsize(file.size()))) {
+        std::cerr << "Failed to write snapshot " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Read-only memory mapping of a whole file
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path) {
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            return;
+        }
+
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+            return;
+        }
+
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping == nullptr) {
+            return;
+        }
+
+        void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (view != nullptr) {
+            bytes = static_cast<const unsigned char*>(view);
+            size = size_t(fileSize.QuadPart);
+        }
+#else
+        descriptor = open(path.c_str(), O_RDONLY);
+        if (descriptor < 0) {
+            return;
+        }
+
+        struct stat status;
+        if (fstat(descriptor, &status) != 0 || status.st_size == 0) {
+            return;
+        }
+
+        void* view = mmap(nullptr, size_t(status.st_size), PROT_READ, MAP_PRIVATE, descriptor, 0);
+        if (view != MAP_FAILED) {
+            bytes = static_cast<const unsigned char*>(view);
+            size = size_t(status.st_size);
+        }
+#endif
+    }
+
+    ~MappedFile() {
+#ifdef _WIN32
+        if (bytes != nullptr) {
+            UnmapViewOfFile(bytes);
+        }
+        if (mapping != nullptr) {
+            CloseHandle(mapping);
+        }
+        if (file != INVALID_HANDLE_VALUE) {
+            CloseHandle(file);
+        }
+#else
+        if (bytes != nullptr) {
+            munmap(const_cast<unsigned char*>(bytes), size);
+        }
+        if (descriptor >= 0) {
+            close(descriptor);
+        }
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool isOpen() const { return bytes != nullptr; }
+
+    const unsigned char* bytes = nullptr;
+    size_t size = 0;
+
+private:
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#else
+    int descriptor = -1;
+#endif
+};
+
+static DirtyRect pendingRect(const SnapshotChunk& entry) {
+    DirtyRect rect;
+    rect.minX = entry.pendingMinX;
+    rect.minY = entry.pendingMinY;
+    rect.maxX = entry.pendingMaxX;
+    rect.maxY = entry.pendingMaxY;
+    return rect;
+}
+
+// A pending rect has to be empty or lie inside its chunk, anything else would send updates outside it
+static bool isValidPendingRect(const DirtyRect& rect, const ChunkBounds& bounds) {
+    return rect.empty() || (rect.minX >= bounds.x0 && rect.minY >= bounds.y0 && rect.maxX < bounds.x1 && rect.maxY < bounds.y1);
+}
+
+bool LoadSnapshot(const std::string& path) {
+    MappedFile file(path);
+    if (!file.isOpen()) {
+        std::cerr << "Failed to open snapshot " << path << std::endl;
+        return false;
+    }
+
+    SnapshotHeader header;
+    if (file.size < sizeof(header)) {
+        std::cerr << "Snapshot " << path << " is truncated" << std::endl;
+        return false;
+    }
+    std::memcpy(&header, file.bytes, sizeof(header));
+
+    if (std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0) {
+        std::cerr << path << " is not a snapshot" << std::endl;
+        return false;
+    }
+    if (header.version != SNAPSHOT_VERSION) {
+        std::cerr << "Snapshot " << path << " has version " << header.version << ", expected " << SNAPSHOT_VERSION << std::endl;
+        return false;
+    }
+
+    if (header.width == 0 || header.height == 0 || header.width > uint32_t(MAX_GRID_SIDE) || header.height > uint32_t(MAX_GRID_SIDE)) {
+        std::cerr << "Snapshot " << path << " has an unsupported size (" << header.width << "x" << header.height << ")" << std::endl;
+        return false;
+    }
+
+    // The grid takes on the size of the snapshot, one engine per chunk of that size
+    int width = int(header.width);
+    int height = int(header.height);
+    int chunksX = (width + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    int chunksY = (height + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    size_t chunkCount = size_t(chunksX) * chunksY;
+
+    if (header.chunkSize != uint32_t(CHUNK_SIZE) || header.typeCount != uint32_t(materialCount)
+        || header.planeCount != uint32_t(Grid::STORED_PLANE_COUNT) || header.chunkEngineCount != chunkCount
+        || header.rateCount != countRolledRates()) {
+        std::cerr << "Snapshot " << path << " was saved with a different chunk layout or material table (" << header.typeCount
+            << " types)" << std::endl;
+        return false;
+    }
+
+    size_t ratesOffset = sizeof(header);
+    size_t enginesOffset = ratesOffset + header.rateCount * sizeof(double);
+    size_t tableOffset = enginesOffset + chunkCount * 4 * sizeof(uint64_t);
+    size_t dataOffset = tableOffset + chunkCount * sizeof(SnapshotChunk);
+    if (file.size < dataOffset) {
+        std::cerr << "Snapshot " << path << " is truncated" << std::endl;
+        return false;
+    }
+
+    // Check the whole table before touching the grid, so only corrupt chunk data can leave it half loaded
+    std::vector<SnapshotChunk> entries(chunkCount);
+    std::memcpy(entries.data(), file.bytes + tableOffset, chunkCount * sizeof(SnapshotChunk));
+    for (int cy = 0; cy < chunksY; cy++) {
+        for (int cx = 0; cx < chunksX; cx++) {
+            const SnapshotChunk& entry = entries[size_t(cy) * chunksX + cx];
+            if (entry.offset < dataOffset || entry.offset > file.size || entry.size > file.size - entry.offset
+                || !isValidPendingRect(pendingRect(entry), ChunkBounds(cx, cy, width, height))) {
+                std::cerr << "Snapshot " << path << " has a corrupt chunk table" << std::endl;
+                return false;
+            }
+        }
+    }
+
+    if (width != grid.getWidth() || height != grid.getHeight()) {
+        ResizeWorld(width, height);
+    }
+
+    std::vector<unsigned char> gathered;
+    for (int cy = 0; cy < chunksY; cy++) {
+        for (int cx = 0; cx < chunksX; cx++) {
+            const SnapshotChunk& entry = entries[size_t(cy) * chunksX + cx];
+            ChunkBounds bounds(cx, cy);
+            if (!DecodeCells(file.bytes + entry.offset, entry.size, bounds.x0, bounds.y0, bounds.x1, bounds.y1, gathered)) {
+                std::cerr << "Snapshot " << path << " has corrupt data in chunk " << cx << ", " << cy << std::endl;
+                InitializeGrid();
+                return false;
+            }
+        }
+    }
+
+    // Type ids index the particle table, so an id out of range would read past it
+    std::array<Grid::RawPlane, Grid::STORED_PLANE_COUNT> planes = grid.storedPlanes();
+    const unsigned char* types = planes[0].bytes;
+    const unsigned char* rememberedTypes = planes[1].bytes;
+    for (size_t i = 0; i < size_t(width) * height; i++) {
+        if (types[i] >= materialCount || rememberedTypes[i] >= materialCount) {
+            std::cerr << "Snapshot " << path << " contains an unknown particle type" << std::endl;
+            InitializeGrid();
+            return false;
+        }
+    }
+
+    const unsigned char* rate = file.bytes + ratesOffset;
+    forEachRolledRate([&](double& value) {
+        std::memcpy(&value, rate, sizeof(value));
+        rate += sizeof(value);
+    });
+
+    simulationTick = header.simulationTick;
+    SimRandom::sharedEngine().setState({ header.sharedEngine[0], header.sharedEngine[1], header.sharedEngine[2], header.sharedEngine[3] });
+    std::vector<SimRandom::Engine>& chunkEngines = getChunkEngines();
+    for (size_t i = 0; i < chunkEngines.size(); i++) {
+        std::array<uint64_t, 4> state;
+        std::memcpy(state.data(), file.bytes + enginesOffset + i * sizeof(state), sizeof(state));
+        chunkEngines[i].setState(state);
+    }
+
+    grid.rebuildCaches();
+    for (int cy = 0; cy < chunksY; cy++) {
+        for (int cx = 0; cx < chunksX; cx++) {
+            grid.chunks.setPendingRect(cx, cy, pendingRect(entries[size_t(cy) * chunksX + cx]));
+            grid.chunks.setThermallyActive(cx, cy, entries[size_t(cy) * chunksX + cx].thermallyActive != 0);
+        }
+    }
+    // Counts left over from the previous world would let a woken chunk sleep before trying both block offsets
+    ResetBlockQuietTicks();
+    return true;
+}
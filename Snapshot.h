@@ -0,0 +1,32 @@
+#pragma once
+
+#include "Game.h"
+
+// Binary world snapshots
+// A snapshot holds every stored plane of the grid, the simulation tick, the material rates rolled at startup,
+// the state of every random engine, the dirty rects collected for the next tick and which chunks still conduct
+// heat, so a loaded world carries on exactly as the saved one would under the same movement mode. Velocity
+// movement and the Moore or Margolus neighbourhood are not stored, the loaded world runs with the current ones.
+// The grid is stored chunk by chunk, every plane of a chunk run-length encoded on its own. A table of chunk
+// offsets follows the header, so a chunk can be decoded without touching the rest of the file.
+// Files are written in the byte order of the machine (little-endian on every platform the game targets).
+
+// Bumped whenever the layout changes, files of another version are rejected
+const uint32_t SNAPSHOT_VERSION = 3;
+
+// Write the current world to path, returns false and prints why on failure
+bool SaveSnapshot(const std::string& path);
+
+// Replace the current world with the one saved in path, the file is memory-mapped and decoded in place
+// Call after InitializeSimulation, the grid is resized to the size of the snapshot. Returns false and prints
+// why on failure, a file that turns out to be corrupt halfway through leaves an empty grid behind.
+bool LoadSnapshot(const std::string& path);
+
+// The encoding snapshots store every chunk in, also used to page chunks out (see WorldPager.h)
+// Appends every stored plane of the grid cells in [x0, x1) x [y0, y1) to out, each plane run-length encoded
+// on its own. scratch is working space, handing the same buffer back in avoids allocating.
+void EncodeCells(int x0, int y0, int x1, int y1, std::vector<unsigned char>& out, std::vector<unsigned char>& scratch);
+
+// Inverse of EncodeCells, writes the cells straight into the grid planes without marking anything dirty
+// Returns false if the size bytes at bytes run out before every plane is filled.
+bool DecodeCells(const unsigned char* bytes, size_t size, int x0, int y0, int x1, int y1, std::vector<unsigned char>& scratch);
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size work-stealing thread pool
+// parallelFor splits the task indices into one contiguous range per participant. Every participant works
+// through its own range from the front and, once it runs dry, steals from the back of the others.
+// The calling thread takes part as well, so a pool of N threads runs on N + 1 participants.
+class WorkStealingPool {
+public:
+    // threadStart, if given, runs once on every worker thread before it takes any task
+    explicit WorkStealingPool(int threadCount, void (*threadStart)() = nullptr) {
+        int participants = std::max(threadCount, 0) + 1;
+        for (int i = 0; i < participants; i++) {
+            queues.push_back(std::make_unique<TaskQueue>());
+        }
+        for (int i = 1; i < participants; i++) {
+            threads.emplace_back(&WorkStealingPool::workerLoop, this, i, threadStart);
+        }
+    }
+
+    ~WorkStealingPool() {
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            stopping = true;
+        }
+        wakeCondition.notify_all();
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+    }
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    // Number of threads doing work, including the caller
+    int getParticipantCount() const { return int(queues.size()); }
+
+    // Runs task(i) for every i in [0, count) and returns once all of them have finished
+    // The task is called through a plain function pointer, so handing one over never allocates
+    template<typename Task>
+    void parallelFor(int count, const Task& task) {
+        if (count <= 0) {
+            return;
+        }
+
+        currentTask = &task;
+        invokeTask = [](const void* context, int index) { (*static_cast<const Task*>(context))(index); };
+        remaining.store(count);
+
+        int participants = int(queues.size());
+        for (int i = 0; i < participants; i++) {
+            TaskQueue& queue = *queues[i];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.begin = int(int64_t(count) * i / participants);
+            queue.end = int(int64_t(count) * (i + 1) / participants);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            generation++;
+        }
+        wakeCondition.notify_all();
+
+        runTasks(0);
+
+        std::unique_lock<std::mutex> lock(wakeMutex);
+        doneCondition.wait(lock, [this] { return remaining.load() == 0; });
+    }
+
+private:
+    // Tasks in [begin, end) are still queued, a range needs no storage so dealing never allocates
+    struct TaskQueue {
+        std::mutex mutex;
+        int begin = 0;
+        int end = 0;
+    };
+
+    bool popLocal(int participant, int& task) {
+        TaskQueue& queue = *queues[participant];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.begin == queue.end) {
+            return false;
+        }
+        task = queue.begin++;
+        return true;
+    }
+
+    bool steal(int participant, int& task) {
+        for (size_t offset = 1; offset < queues.size(); offset++) {
+            TaskQueue& queue = *queues[(participant + offset) % queues.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.begin != queue.end) {
+                task = --queue.end;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void runTasks(int participant) {
+        int task;
+        while (popLocal(participant, task) || steal(participant, task)) {
+            invokeTask(currentTask, task);
+            if (remaining.fetch_sub(1) == 1) {
+                std::lock_guard<std::mutex> lock(wakeMutex);
+                doneCondition.notify_all();
+            }
+        }
+    }
+
+    void workerLoop(int participant, void (*threadStart)()) {
+        if (threadStart) {
+            threadStart();
+        }
+
+        uint64_t seenGeneration = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(wakeMutex);
+                wakeCondition.wait(lock, [&] { return stopping || generation != seenGeneration; });
+                if (stopping) {
+                    return;
+                }
+                seenGeneration = generation;
+            }
+            runTasks(participant);
+        }
+    }
+
+    std::vector<std::unique_ptr<TaskQueue>> queues;
+    std::vector<std::thread> threads;
+
+    std::mutex wakeMutex;
+    std::condition_variable wakeCondition;
+    std::condition_variable doneCondition;
+    uint64_t generation = 0;
+    bool stopping = false;
+
+    const void* currentTask = nullptr;
+    void (*invokeTask)(const void*, int) = nullptr;
+    std::atomic<int> remaining{ 0 };
+};
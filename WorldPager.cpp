@@ -0,0 +1,247 @@
+#include "WorldPager.h"
+#include "Snapshot.h"
+
+#include <chrono>
+#include <cstring>
+
+// Room left for a page to grow before it has to move to the end of the file
+static uint32_t pageCapacity(size_t size) {
+    return uint32_t((size + size / 4 + 63) / 64 * 64);
+}
+
+static bool seekTo(FILE* file, uint64_t offset) {
+#ifdef _WIN32
+    return _fseeki64(file, int64_t(offset), SEEK_SET) == 0;
+#else
+    return fseeko(file, off_t(offset), SEEK_SET) == 0;
+#endif
+}
+
+bool WorldPager::open(const std::string& pagePath, int width, int height, int windowX, int windowY) {
+    close();
+
+    if (grid.getWidth() % CHUNK_SIZE != 0 || grid.getHeight() % CHUNK_SIZE != 0 || width % CHUNK_SIZE != 0 || height % CHUNK_SIZE != 0) {
+        std::cerr << "Paged worlds need a grid and a world that are a whole number of " << CHUNK_SIZE << " cell chunks in size" << std::endl;
+        return false;
+    }
+    if (width < grid.getWidth() || height < grid.getHeight()) {
+        std::cerr << "A " << width << "x" << height << " world can't hold a " << grid.getWidth() << "x" << grid.getHeight() << " window" << std::endl;
+        return false;
+    }
+
+    file = std::fopen(pagePath.c_str(), "w+b");
+    if (file == nullptr) {
+        std::cerr << "Failed to create page file " << pagePath << std::endl;
+        return false;
+    }
+
+    path = pagePath;
+    fileEnd = 0;
+    worldWidth = width;
+    worldHeight = height;
+    worldChunksX = width / CHUNK_SIZE;
+    worldChunksY = height / CHUNK_SIZE;
+    windowChunkX = std::clamp(windowX / CHUNK_SIZE, 0, worldChunksX - grid.chunks.getChunksX());
+    windowChunkY = std::clamp(windowY / CHUNK_SIZE, 0, worldChunksY - grid.chunks.getChunksY());
+
+    pages.assign(size_t(worldChunksX) * worldChunksY, Page());
+    stats = PagerStats();
+
+    // Walls along the edge of the grid that aren't on the edge of the world would box the window's contents in
+    // for good, the wall around the world comes from pageIn instead
+    int gridWidth = grid.getWidth();
+    int gridHeight = grid.getHeight();
+    auto clearWall = [&](int x, int y) {
+        int worldX = windowChunkX * CHUNK_SIZE + x;
+        int worldY = windowChunkY * CHUNK_SIZE + y;
+        bool onWorldEdge = worldX == 0 || worldY == 0 || worldX == worldWidth - 1 || worldY == worldHeight - 1;
+        if (!onWorldEdge && grid.type(x, y) == ParticleType::WALL) {
+            grid.set(x, y, Particle(ParticleType::EMPTY));
+        }
+    };
+    for (int x = 0; x < gridWidth; x++) {
+        clearWall(x, 0);
+        clearWall(x, gridHeight - 1);
+    }
+    for (int y = 1; y < gridHeight - 1; y++) {
+        clearWall(0, y);
+        clearWall(gridWidth - 1, y);
+    }
+    return true;
+}
+
+void WorldPager::close() {
+    if (file != nullptr) {
+        std::fclose(file);
+        file = nullptr;
+    }
+    pages.clear();
+    pages.shrink_to_fit();
+}
+
+bool WorldPager::focus(int x, int y) {
+    int windowChunksX = grid.chunks.getChunksX();
+    int windowChunksY = grid.chunks.getChunksY();
+
+    // Chunk the window would start at with (x, y) in its middle
+    int targetX = std::clamp(x / CHUNK_SIZE - windowChunksX / 2, 0, worldChunksX - windowChunksX);
+    int targetY = std::clamp(y / CHUNK_SIZE - windowChunksY / 2, 0, worldChunksY - windowChunksY);
+
+    // Small moves are left alone so a focus wobbling around doesn't page the same chunks back and forth
+    int marginX = std::max(1, windowChunksX / 4);
+    int marginY = std::max(1, windowChunksY / 4);
+    if (std::abs(targetX - windowChunkX) < marginX && std::abs(targetY - windowChunkY) < marginY) {
+        return true;
+    }
+    return moveWindow(targetX, targetY);
+}
+
+bool WorldPager::moveWindow(int chunkX, int chunkY) {
+    auto start = std::chrono::steady_clock::now();
+    int windowChunksX = grid.chunks.getChunksX();
+    int windowChunksY = grid.chunks.getChunksY();
+
+    auto inWindow = [&](int worldChunkX, int worldChunkY, int originX, int originY) {
+        return worldChunkX >= originX && worldChunkX < originX + windowChunksX && worldChunkY >= originY && worldChunkY < originY + windowChunksY;
+    };
+
+    for (int cy = 0; cy < windowChunksY; cy++) {
+        for (int cx = 0; cx < windowChunksX; cx++) {
+            int worldChunkX = windowChunkX + cx;
+            int worldChunkY = windowChunkY + cy;
+            if (!inWindow(worldChunkX, worldChunkY, chunkX, chunkY) && !pageOut(cx, cy, pageAt(worldChunkX, worldChunkY))) {
+                return false;
+            }
+        }
+    }
+
+    shiftResident((windowChunkX - chunkX) * CHUNK_SIZE, (windowChunkY - chunkY) * CHUNK_SIZE);
+
+    int oldChunkX = windowChunkX;
+    int oldChunkY = windowChunkY;
+    windowChunkX = chunkX;
+    windowChunkY = chunkY;
+
+    for (int cy = 0; cy < windowChunksY; cy++) {
+        for (int cx = 0; cx < windowChunksX; cx++) {
+            int worldChunkX = windowChunkX + cx;
+            int worldChunkY = windowChunkY + cy;
+            if (!inWindow(worldChunkX, worldChunkY, oldChunkX, oldChunkY)
+                && !pageIn(cx, cy, pageAt(worldChunkX, worldChunkY), worldChunkX, worldChunkY)) {
+                return false;
+            }
+        }
+    }
+
+    // The cells along the old edges have new neighbours now, one full update settles everything again
+    grid.rebuildCaches();
+    grid.chunks.wakeAll();
+
+    stats.moves++;
+    stats.fileBytes = fileEnd;
+    stats.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return true;
+}
+
+// Move every stored plane of the grid by (shiftX, shiftY) cells, dropping whatever moves off it
+// Rows are walked away from the direction of the shift so no row is overwritten before it was copied.
+void WorldPager::shiftResident(int shiftX, int shiftY) {
+    int width = grid.getWidth();
+    int height = grid.getHeight();
+    int x0 = std::max(0, -shiftX);
+    int x1 = std::min(width, width - shiftX);
+    int y0 = std::max(0, -shiftY);
+    int y1 = std::min(height, height - shiftY);
+    if (x0 >= x1 || y0 >= y1 || (shiftX == 0 && shiftY == 0)) {
+        return;
+    }
+
+    for (const Grid::RawPlane& plane : grid.storedPlanes()) {
+        size_t rowBytes = size_t(x1 - x0) * plane.elementSize;
+        for (int i = 0; i < y1 - y0; i++) {
+            int y = shiftY > 0 ? y1 - 1 - i : y0 + i;
+            std::memmove(plane.bytes + grid.index(x0 + shiftX, y + shiftY) * plane.elementSize,
+                plane.bytes + grid.index(x0, y) * plane.elementSize, rowBytes);
+        }
+    }
+}
+
+bool WorldPager::pageOut(int cx, int cy, Page& page) {
+    int x0 = cx * CHUNK_SIZE;
+    int y0 = cy * CHUNK_SIZE;
+
+    // Empty cells carry nothing worth keeping, a chunk of only empty cells is stored as a flag
+    bool empty = true;
+    for (int y = y0; y < y0 + CHUNK_SIZE && empty; y++) {
+        for (int x = x0; x < x0 + CHUNK_SIZE; x++) {
+            if (grid.type(x, y) != ParticleType::EMPTY) {
+                empty = false;
+                break;
+            }
+        }
+    }
+    stats.pagesOut++;
+    if (empty) {
+        page.state = PageState::EMPTY;
+        return true;
+    }
+
+    encoded.clear();
+    EncodeCells(x0, y0, x0 + CHUNK_SIZE, y0 + CHUNK_SIZE, encoded, scratch);
+
+    if (page.capacity < encoded.size()) {
+        page.offset = fileEnd;
+        page.capacity = pageCapacity(encoded.size());
+        fileEnd += page.capacity;
+    }
+    page.size = uint32_t(encoded.size());
+    page.state = PageState::STORED;
+    page.pagedOutTick = simulationTick;
+
+    if (!seekTo(file, page.offset) || std::fwrite(encoded.data(), 1, encoded.size(), file) != encoded.size()) {
+        std::cerr << "Failed to write to page file " << path << std::endl;
+        return false;
+    }
+    stats.bytesWritten += encoded.size();
+    return true;
+}
+
+bool WorldPager::pageIn(int cx, int cy, Page& page, int worldChunkX, int worldChunkY) {
+    int x0 = cx * CHUNK_SIZE;
+    int y0 = cy * CHUNK_SIZE;
+
+    if (page.state == PageState::STORED) {
+        encoded.resize(page.size);
+        if (!seekTo(file, page.offset) || std::fread(encoded.data(), 1, page.size, file) != page.size
+            || !DecodeCells(encoded.data(), encoded.size(), x0, y0, x0 + CHUNK_SIZE, y0 + CHUNK_SIZE, scratch)) {
+            std::cerr << "Failed to read chunk " << worldChunkX << ", " << worldChunkY << " from page file " << path << std::endl;
+            return false;
+        }
+        // Expiries are absolute ticks, time stood still for the chunk while it was on disk
+        grid.delayExpiries(x0, y0, x0 + CHUNK_SIZE, y0 + CHUNK_SIZE, simulationTick - page.pagedOutTick);
+        stats.pagesIn++;
+        stats.bytesRead += page.size;
+        return true;
+    }
+
+    for (int y = y0; y < y0 + CHUNK_SIZE; y++) {
+        for (int x = x0; x < x0 + CHUNK_SIZE; x++) {
+            grid.set(x, y, Particle(ParticleType::EMPTY));
+        }
+    }
+
+    // A chunk seen for the first time gets the wall around the world where it lies on the edge
+    if (page.state == PageState::UNTOUCHED) {
+        for (int y = y0; y < y0 + CHUNK_SIZE; y++) {
+            for (int x = x0; x < x0 + CHUNK_SIZE; x++) {
+                int worldX = worldChunkX * CHUNK_SIZE + x - x0;
+                int worldY = worldChunkY * CHUNK_SIZE + y - y0;
+                if (worldX == 0 || worldY == 0 || worldX == worldWidth - 1 || worldY == worldHeight - 1) {
+                    grid.set(x, y, Particle(ParticleType::WALL));
+                }
+            }
+        }
+        stats.pagesCreated++;
+    }
+    return true;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "Game.h"
+
+#include <cstdio>
+
+// Totals since the pager was opened
+struct PagerStats {
+    int moves = 0; // Times the window moved
+    uint64_t pagesOut = 0; // Chunks that left the window
+    uint64_t pagesIn = 0; // Chunks read back from the page file
+    uint64_t pagesCreated = 0; // Chunks that came into the window for the first time
+    uint64_t bytesWritten = 0;
+    uint64_t bytesRead = 0;
+    uint64_t fileBytes = 0; // Size of the page file
+    double seconds = 0.0; // Spent moving the window
+};
+
+// A world much bigger than the grid, kept on disk a chunk at a time
+// The grid is a window onto the world, a whole number of chunks in size and aligned to the chunk grid, and
+// only the window is simulated. When the focus (whatever should stay active) gets near an
+// edge of the window, the window moves: chunks that fall out of it are encoded the way snapshots store them
+// and written to the page file, chunks that come into it are read back in, or start out empty (walled along
+// the edge of the world) the first time. Chunks that stay in the window are moved along inside the grid.
+// Outside the window time stands still, and cells in the window treat its edge like the edge of the grid.
+// The page table takes 24 bytes per chunk of the world, a 32768 x 32768 world is 24 MB of table.
+// Only Headless pages worlds so far, moving the focus along a fixed path. The game has no camera that pans, and
+// its 240x160 grid isn't a whole number of chunks in size.
+class WorldPager {
+public:
+    ~WorldPager() { close(); }
+
+    // Start a worldWidth x worldHeight world with the grid as its window, placed with its bottom left corner at
+    // world cell (windowX, windowY), rounded down to a chunk. Whatever the grid holds becomes that part of the
+    // world, except walls along the edge of the grid that lie inside the world, which are cleared. Both the grid
+    // and the world have to be a whole number of chunks in size. The page file at path is created or
+    // overwritten. Returns false and prints why on failure.
+    bool open(const std::string& path, int worldWidth, int worldHeight, int windowX, int windowY);
+    void close();
+
+    bool isOpen() const { return file != nullptr; }
+
+    int getWorldWidth() const { return worldWidth; }
+    int getWorldHeight() const { return worldHeight; }
+
+    // World cell of grid cell (0, 0)
+    int getWindowX() const { return windowChunkX * CHUNK_SIZE; }
+    int getWindowY() const { return windowChunkY * CHUNK_SIZE; }
+
+    // Keep world cell (x, y) well inside the window, moving the window once it gets within a quarter of the
+    // window of an edge. Call between ticks. Returns false and prints why if the page file fails.
+    bool focus(int x, int y);
+
+    const PagerStats& getStats() const { return stats; }
+
+private:
+    enum class PageState : uint8_t {
+        UNTOUCHED, // Never left the window, starts out empty
+        EMPTY, // Left the window without a particle in it, takes no space in the file
+        STORED,
+    };
+
+    struct Page {
+        uint64_t offset = 0;
+        uint32_t size = 0;
+        uint32_t capacity = 0; // Bytes reserved at offset, a page that grows past it moves to the end of the file
+        uint32_t pagedOutTick = 0; // simulationTick when the chunk left the window, its lifetimes resume from there
+        PageState state = PageState::UNTOUCHED;
+    };
+
+    bool moveWindow(int chunkX, int chunkY);
+    void shiftResident(int shiftX, int shiftY);
+    bool pageOut(int cx, int cy, Page& page);
+    bool pageIn(int cx, int cy, Page& page, int worldChunkX, int worldChunkY);
+
+    Page& pageAt(int worldChunkX, int worldChunkY) { return pages[size_t(worldChunkY) * worldChunksX + worldChunkX]; }
+
+    std::string path;
+    FILE* file = nullptr;
+    uint64_t fileEnd = 0;
+
+    int worldWidth = 0;
+    int worldHeight = 0;
+    int worldChunksX = 0;
+    int worldChunksY = 0;
+    int windowChunkX = 0; // World chunk of grid chunk (0, 0)
+    int windowChunkY = 0;
+
+    std::vector<Page> pages;
+    std::vector<unsigned char> encoded;
+    std::vector<unsigned char> scratch;
+    PagerStats stats;
+};